@@ -45,6 +45,12 @@
 #if defined(_MSC_VER)
 typedef __int64 ssize_t;
 #include <windows.h>
+
+/* Scatter buffer definition as provided by POSIX sys/uio.h */
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
 #endif
 
 #include <stdint.h>
@@ -133,6 +139,39 @@ static inline long jent_ncpu(void)
 
 static inline void jent_yield(void) { }
 
+static inline void jent_cpu_relax(void) { YieldProcessor(); }
+
+/* Atomic operations on flags shared between threads */
+static inline int jent_atomic_load(volatile int *v)
+{
+	return (int)_InterlockedOr((volatile long *)v, 0);
+}
+
+static inline void jent_atomic_store(volatile int *v, int val)
+{
+	_InterlockedExchange((volatile long *)v, val);
+}
+
+static inline int jent_atomic_xchg(volatile int *v, int val)
+{
+	return (int)_InterlockedExchange((volatile long *)v, val);
+}
+
+static inline void jent_atomic_add(volatile int *v, int val)
+{
+	_InterlockedExchangeAdd((volatile long *)v, val);
+}
+
+static inline uint64_t jent_atomic_load64(volatile uint64_t *v)
+{
+	return (uint64_t)_InterlockedOr64((volatile __int64 *)v, 0);
+}
+
+static inline void jent_atomic_store64(volatile uint64_t *v, uint64_t val)
+{
+	_InterlockedExchange64((volatile __int64 *)v, (__int64)val);
+}
+
 static inline uint32_t jent_cache_size_roundup(void)
 {
 	return 0;
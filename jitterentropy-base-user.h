@@ -56,6 +56,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -63,10 +64,11 @@
 #include <errno.h>
 #include <sched.h>
 
-/* Timer-less entropy source */
-#ifdef JENT_CONF_ENABLE_INTERNAL_TIMER
+/* Timer-less entropy source and thread-based API calls */
+#if defined(JENT_CONF_ENABLE_INTERNAL_TIMER) || \
+    defined(JENT_CONF_ENABLE_THREADS)
 #include <pthread.h>
-#endif /* JENT_CONF_ENABLE_INTERNAL_TIMER */
+#endif
 
 #ifdef LIBGCRYPT
 #include <config.h>
@@ -211,7 +213,12 @@ static inline void *jent_zalloc(size_t len)
 #else
 	/* we have no secure memory allocation! Hence
 	 * we do not set CONFIG_CRYPTO_CPU_JITTERENTROPY_SECURE_MEMORY */
-	tmp = malloc(len);
+	/*
+	 * Align all allocations to a cache line to prevent the entropy
+	 * collector state from sharing cache lines with unrelated data.
+	 */
+	if (posix_memalign(&tmp, JENT_CACHELINE_SIZE, len))
+		tmp = NULL;
 #endif /* LIBGCRYPT */
 	if(NULL != tmp)
 		memset(tmp, 0, len);
@@ -293,146 +300,64 @@ static inline long jent_ncpu(void)
 
 #ifdef __linux__
 
-# if defined(_SC_LEVEL1_DCACHE_SIZE) &&					\
-     defined(_SC_LEVEL2_CACHE_SIZE) &&					\
-     defined(_SC_LEVEL3_CACHE_SIZE)
+/* jent_cache_size_roundup is provided by jitterentropy-cache.c */
+#define JENT_CACHE_TOPOLOGY
 
-static inline void jent_get_cachesize(long *l1, long *l2, long *l3)
+#else /* __linux__ */
+
+static inline uint32_t jent_cache_size_roundup(void)
 {
-	*l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
-	*l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
-	*l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+	return 0;
 }
 
-# else
+#endif /* __linux__ */
 
-static inline void jent_get_cachesize(long *l1, long *l2, long *l3)
+static inline void jent_yield(void)
 {
-#define JENT_SYSFS_CACHE_DIR "/sys/devices/system/cpu/cpu0/cache"
-	long val;
-	unsigned int i;
-	char buf[10], file[50];
-	int fd = 0;
-
-	/* Iterate over all caches */
-	for (i = 0; i < 4; i++) {
-		unsigned int shift = 0;
-		char *ext;
-
-		/*
-		 * Check the cache type - we are only interested in Unified
-		 * and Data caches.
-		 */
-		memset(buf, 0, sizeof(buf));
-		snprintf(file, sizeof(file), "%s/index%u/type",
-			 JENT_SYSFS_CACHE_DIR, i);
-		fd = open(file, O_RDONLY);
-		if (fd < 0)
-			continue;
-		while (read(fd, buf, sizeof(buf)) < 0 && errno == EINTR);
-		close(fd);
-		buf[sizeof(buf) - 1] = '\0';
-
-		if (strncmp(buf, "Data", 4) && strncmp(buf, "Unified", 7))
-			continue;
-
-		/* Get size of cache */
-		memset(buf, 0, sizeof(buf));
-		snprintf(file, sizeof(file), "%s/index%u/size",
-			 JENT_SYSFS_CACHE_DIR, i);
-
-		fd = open(file, O_RDONLY);
-		if (fd < 0)
-			continue;
-		while (read(fd, buf, sizeof(buf)) < 0 && errno == EINTR);
-		close(fd);
-		buf[sizeof(buf) - 1] = '\0';
-
-		ext = strstr(buf, "K");
-		if (ext) {
-			shift = 10;
-			*ext = '\0';
-		} else {
-			ext = strstr(buf, "M");
-			if (ext) {
-				shift = 20;
-				*ext = '\0';
-			}
-		}
-
-		val = strtol(buf, NULL, 10);
-		if (val == LONG_MAX)
-			continue;
-		val <<= shift;
-
-		if (!*l1)
-			*l1 = val;
-		else if (!*l2)
-			*l2 = val;
-		else {
-			*l3 = val;
-			break;
-		}
-	}
-#undef JENT_SYSFS_CACHE_DIR
+	sched_yield();
 }
 
-# endif
+/* Hint to the CPU that the caller is busy-waiting */
+static inline void jent_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__asm__ __volatile__("pause" ::: "memory");
+#elif defined(__aarch64__) || (defined(__arm__) && __ARM_ARCH >= 7)
+	__asm__ __volatile__("yield" ::: "memory");
+#else
+	__asm__ __volatile__("" ::: "memory");
+#endif
+}
 
-static inline uint32_t jent_cache_size_roundup(void)
+/* Atomic operations on flags shared between threads */
+static inline int jent_atomic_load(volatile int *v)
 {
-	static int checked = 0;
-	static uint32_t cache_size = 0;
-
-	if (!checked) {
-		long l1 = 0, l2 = 0, l3 = 0;
-
-		jent_get_cachesize(&l1, &l2, &l3);
-		checked = 1;
-
-		/* Cache size reported by system */
-		if (l1 > 0)
-			cache_size += (uint32_t)l1;
-		if (l2 > 0)
-			cache_size += (uint32_t)l2;
-		if (l3 > 0)
-			cache_size += (uint32_t)l3;
-
-		/*
-		 * Force the output_size to be of the form
-		 * (bounding_power_of_2 - 1).
-		 */
-		cache_size |= (cache_size >> 1);
-		cache_size |= (cache_size >> 2);
-		cache_size |= (cache_size >> 4);
-		cache_size |= (cache_size >> 8);
-		cache_size |= (cache_size >> 16);
-
-		if (cache_size == 0)
-			return 0;
-
-		/*
-		 * Make the output_size the smallest power of 2 strictly
-		 * greater than cache_size.
-		 */
-		cache_size++;
-	}
+	return __atomic_load_n(v, __ATOMIC_ACQUIRE);
+}
 
-	return cache_size;
+static inline void jent_atomic_store(volatile int *v, int val)
+{
+	__atomic_store_n(v, val, __ATOMIC_RELEASE);
 }
 
-#else /* __linux__ */
+static inline int jent_atomic_xchg(volatile int *v, int val)
+{
+	return __atomic_exchange_n(v, val, __ATOMIC_ACQ_REL);
+}
 
-static inline uint32_t jent_cache_size_roundup(void)
+static inline void jent_atomic_add(volatile int *v, int val)
 {
-	return 0;
+	__atomic_fetch_add(v, val, __ATOMIC_ACQ_REL);
 }
 
-#endif /* __linux__ */
+static inline uint64_t jent_atomic_load64(volatile uint64_t *v)
+{
+	return __atomic_load_n(v, __ATOMIC_ACQUIRE);
+}
 
-static inline void jent_yield(void)
+static inline void jent_atomic_store64(volatile uint64_t *v, uint64_t val)
 {
-	sched_yield();
+	__atomic_store_n(v, val, __ATOMIC_RELEASE);
 }
 
 /* --- helpers needed in user space -- */
@@ -64,6 +64,27 @@ extern "C" {
  * with the POSIX threads library is needed.
  */
 
+/*
+ * Enable the thread-based API calls with JENT_CONF_ENABLE_THREADS
+ *
+ * The background entropy generation operates an entropy collector with a
+ * thread of its own and jent_read_entropy_tls uses one entropy collector per
+ * thread. This option requires the linking with the POSIX threads library
+ * independent of JENT_CONF_ENABLE_INTERNAL_TIMER. If it is disabled, these
+ * API calls return -EOPNOTSUPP.
+ */
+
+/*
+ * Replay a recorded timer trace with JENT_CONF_TIMER_REPLAY
+ *
+ * For reproducible tests and benchmarks, the time stamp source can be
+ * replaced by a trace of recorded time deltas registered with
+ * jent_entropy_switch_timer_replay. Each time delta measurement consumes
+ * the next trace entry, i.e. the measurement, the health tests and the
+ * conditioning operate deterministically. This option must not be enabled
+ * for production use.
+ */
+
 /*
  * Disable the loop shuffle operation
  *
@@ -90,10 +111,20 @@ extern "C" {
 
 /*
  * Shall the jent_memaccess use a (statistically) random selection for the
- * memory to update?
+ * memory to update by default? Both patterns are always compiled in, the
+ * flags JENT_MEMACCESS_SEQUENTIAL and JENT_MEMACCESS_RANDOM select the
+ * pattern for an entropy collector at runtime.
  */
 #define JENT_RANDOM_MEMACCESS
 
+/*
+ * Size of a CPU cache line. The entropy collector state is aligned to it and
+ * data written by different threads is kept on different cache lines.
+ */
+#ifndef JENT_CACHELINE_SIZE
+#define JENT_CACHELINE_SIZE 64
+#endif
+
 /***************************************************************************
  * Jitter RNG State Definition Section
  ***************************************************************************/
@@ -106,6 +137,8 @@ extern "C" {
 
 #define SHA3_256_SIZE_DIGEST_BITS	256
 #define SHA3_256_SIZE_DIGEST		(SHA3_256_SIZE_DIGEST_BITS >> 3)
+#define SHA3_512_SIZE_DIGEST_BITS	512
+#define SHA3_512_SIZE_DIGEST		(SHA3_512_SIZE_DIGEST_BITS >> 3)
 
 /*
  * The output 256 bits can receive more than 256 bits of min entropy,
@@ -166,6 +199,134 @@ struct jent_notime_thread {
 	void (*jent_notime_stop)(void *ctx);
 };
 
+/**
+ * Function pointer to register an external high-resolution time stamp
+ * source used instead of the time stamp source compiled into the Jitter RNG
+ * with jent_get_nstime.
+ *
+ * The function must return a monotonically increasing time stamp with a
+ * resolution high enough to measure the execution time variations of the
+ * Jitter RNG. The time stamp source is validated with the same power-on
+ * tests that are applied to the built-in time stamp source.
+ *
+ * If the caller wants to register its own time stamp source, it must be done
+ * with the API call jent_entropy_switch_timer_impl before jent_entropy_init
+ * is invoked. After jent_entropy_init is called, changing of the time stamp
+ * source is not allowed.
+ */
+typedef void (*jent_timer_read_cb)(uint64_t *out);
+
+/**
+ * Auxiliary noise source executed between two time stamps
+ *
+ * In addition to the memory access, the caller can register functions that
+ * are executed before each time stamp is taken, e.g. TLB walks, branch
+ * misprediction loops or indirect calls. The variations of their execution
+ * time become part of the measured time delta.
+ *
+ * @var name Name of the noise source for reporting
+ * @var noise Function performing loop_cnt iterations of the noise generating
+ * operation. The function must use the result of its operation, e.g. by
+ * storing it in ctx, to prevent the compiler from removing the operation.
+ * It may be invoked concurrently by different entropy collectors.
+ * @var ctx Context handed to noise
+ * @var min_loop_bits The loop count is at least 2^min_loop_bits
+ * @var max_loop_bits Number of bits of the loop shuffle value added to the
+ * minimum loop count (unless JENT_CONF_DISABLE_LOOP_SHUFFLE is set)
+ *
+ * The noise sources must be registered with the API call
+ * jent_entropy_register_noise_source before jent_entropy_init is invoked
+ * such that the power-on tests cover them. After jent_entropy_init is called,
+ * registering noise sources is not allowed.
+ */
+typedef void (*jent_noise_source_cb)(void *ctx, uint64_t loop_cnt);
+
+struct jent_noise_source {
+	const char *name;
+	jent_noise_source_cb noise;
+	void *ctx;
+	unsigned int min_loop_bits;
+	unsigned int max_loop_bits;
+};
+
+/* Maximum number of auxiliary noise sources */
+#define JENT_NOISE_SOURCES_MAX	8
+
+/*
+ * Time stamp sources evaluated by jent_entropy_init_ex when invoked with
+ * JENT_SELECT_TIMER.
+ */
+#define JENT_TIMER_SRC_HW		0 /* Built-in hardware time stamp */
+#define JENT_TIMER_SRC_EXT		1 /* Source registered by caller */
+#define JENT_TIMER_SRC_MONOTONIC_RAW	2 /* clock_gettime(MONOTONIC_RAW) */
+#define JENT_TIMER_SRC_MONOTONIC	3 /* clock_gettime(MONOTONIC) */
+#define JENT_TIMER_SRC_REALTIME		4 /* clock_gettime(REALTIME) */
+#define JENT_TIMER_SRC_NOTIME		5 /* Internal timer thread */
+#define JENT_TIMER_SRC_MAX		6
+
+/*
+ * Calibration result of one time stamp source: ret holds the result of the
+ * power-on health tests (0 on success, ENOTIME if the source is not
+ * available), sample_ns the wall time of one noise source sample,
+ * min_entropy the SP800-90B Most Common Value estimate per sample in
+ * 1/1000 bits and entropy_rate the resulting min-entropy in bits per second.
+ */
+struct jent_timer_stat {
+	int ret;
+	uint32_t min_entropy;
+	uint64_t sample_ns;
+	uint64_t entropy_rate;
+};
+
+/*
+ * Result of the online entropy estimator: SP800-90B estimates of the
+ * min-entropy per time delta in 1/1000 bits computed over the last
+ * completed window of JENT_ESTIMATOR_WINDOW deltas. The Most Common Value
+ * estimate is calculated over the 8 least significant bits of the deltas,
+ * the Collision and Markov estimates over the same bits as bit string,
+ * scaled to one delta. min_entropy is the minimum of the three, rolling
+ * its exponentially weighted average over all windows, and osr the
+ * smallest oversampling rate justified by rolling (0 if none).
+ */
+#define JENT_ESTIMATOR_WINDOW	(1U<<14)
+struct jent_entropy_estimate {
+	uint64_t samples;
+	uint32_t mcv;
+	uint32_t collision;
+	uint32_t markov;
+	uint32_t min_entropy;
+	uint32_t rolling;
+	unsigned int osr;
+};
+
+/*
+ * Result of jent_autotune for one memory access setting: ret holds 0 on
+ * success, ENOTIME if the setting was not evaluated or an error code of
+ * jent_entropy_init otherwise, flags the flags of the setting, memsize the
+ * size of the memory access buffer, min_entropy the lowest estimate of the
+ * online entropy estimator per time delta in 1/1000 bits, osr the smallest
+ * oversampling rate meeting the requested margin but at least JENT_MIN_OSR,
+ * sample_ns the wall time of one time delta and block_ns the resulting wall
+ * time of one random block. The index is the maximum memory size of the
+ * setting, index 0 is not evaluated.
+ */
+#define JENT_AUTOTUNE_MAX	16 /* Unused, 32kB to 512MB */
+struct jent_autotune_stat {
+	int ret;
+	unsigned int flags;
+	uint32_t memsize;
+	uint32_t min_entropy;
+	unsigned int osr;
+	uint64_t sample_ns;
+	uint64_t block_ns;
+};
+
+/* Noise source variant operating an entropy collector */
+struct jent_noise_ops;
+
+/* Online entropy estimator state */
+struct jent_estimator;
+
 /* The entropy pool */
 struct rand_data
 {
@@ -173,33 +334,49 @@ struct rand_data
 	 * of the RNG are marked as SENSITIVE. A user must not
 	 * access that information while the RNG executes its loops to
 	 * calculate the next random value. */
+
+	/*
+	 * Hot data: accessed for every time stamp sample by the thread
+	 * executing the entropy collection. It is kept together at the start
+	 * of the structure to occupy as few cache lines as possible.
+	 */
 	void *hash_state;		/* SENSITIVE hash state entropy pool */
 	uint64_t prev_time;		/* SENSITIVE Previous time stamp */
 #define DATA_SIZE_BITS (SHA3_256_SIZE_DIGEST_BITS)
+#define DATA_SIZE_BITS_MAX (SHA3_512_SIZE_DIGEST_BITS)
 
 #ifndef JENT_HEALTH_LAG_PREDICTOR
 	uint64_t last_delta;		/* SENSITIVE stuck test */
 	uint64_t last_delta2;		/* SENSITIVE stuck test */
 #endif /* JENT_HEALTH_LAG_PREDICTOR */
 
-	unsigned int flags;		/* Flags used to initialize */
-	unsigned int osr;		/* Oversampling rate */
+	uint64_t jent_common_timer_gcd;	/* Common divisor for all time deltas */
+
+	/* Noise source variant selected during allocation */
+	const struct jent_noise_ops *noise_ops;
+	jent_timer_read_cb timer_cb;	/* External time stamp source */
+
+	/* Online entropy estimator, NULL if not enabled */
+	struct jent_estimator *estimator;
+
+/* Default memory size of the random memory access */
+#ifndef JENT_MEMORY_BITS
+# define JENT_MEMORY_BITS 17
+#endif
+/* Default memory layout of the sequential memory access */
+#ifndef JENT_MEMORY_BLOCKS
+# define JENT_MEMORY_BLOCKS 512
+#endif
+#ifndef JENT_MEMORY_BLOCKSIZE
+# define JENT_MEMORY_BLOCKSIZE 128
+#endif
 
 #ifdef JENT_RANDOM_MEMACCESS
   /* The step size should be larger than the cacheline size. */
-# ifndef JENT_MEMORY_BITS
-#  define JENT_MEMORY_BITS 17
-# endif
 # ifndef JENT_MEMORY_SIZE
 #  define JENT_MEMORY_SIZE (UINT32_C(1)<<JENT_MEMORY_BITS)
 # endif
 #else /* JENT_RANDOM_MEMACCESS */
-# ifndef JENT_MEMORY_BLOCKS
-#  define JENT_MEMORY_BLOCKS 512
-# endif
-# ifndef JENT_MEMORY_BLOCKSIZE
-#  define JENT_MEMORY_BLOCKSIZE 128
-# endif
 # ifndef JENT_MEMORY_SIZE
 #  define JENT_MEMORY_SIZE (JENT_MEMORY_BLOCKS*JENT_MEMORY_BLOCKSIZE)
 # endif
@@ -208,16 +385,17 @@ struct rand_data
 #define JENT_MEMORY_ACCESSLOOPS 128
 	unsigned char *mem;		/* Memory access location with size of
 					 * JENT_MEMORY_SIZE or memsize */
-#ifdef JENT_RANDOM_MEMACCESS
+	/* Random memory access */
 	uint32_t memmask;		/* Memory mask (size of memory - 1) */
-#else
+	/* Sequential memory access */
 	unsigned int memlocation; 	/* Pointer to byte in *mem */
 	unsigned int memblocks;		/* Number of memory blocks in *mem */
 	unsigned int memblocksize; 	/* Size of one memory block in bytes */
-#endif
 	unsigned int memaccessloops;	/* Number of memory accesses per random
 					 * bit generation */
 
+	unsigned int osr;		/* Oversampling rate */
+
 	/* Repetition Count Test */
 	int rct_count;			/* Number of stuck values */
 
@@ -232,20 +410,24 @@ struct rand_data
 					 * window. */
 	uint64_t apt_base;		/* APT base reference */
 	unsigned int health_failure;	/* Permanent health failure */
+	unsigned int collect_count;	/* Measurements of jent_collect_step
+					 * since last block was generated */
 
 	unsigned int apt_base_set:1;	/* APT base reference set? */
 	unsigned int fips_enabled:1;
 	unsigned int enable_notime:1;	/* Use internal high-res timer */
+	unsigned int notime_ticking:1;	/* Internal timer thread running? */
 	unsigned int max_mem_set:1;	/* Maximum memory configured by user */
+	unsigned int collect_primed:1;	/* jent_collect_step primed timer? */
 
 #ifdef JENT_CONF_ENABLE_INTERNAL_TIMER
-	volatile uint8_t notime_interrupt;	/* indicator to interrupt ctr */
-	volatile uint64_t notime_timer;		/* high-res timer mock-up */
 	uint64_t notime_prev_timer;		/* previous timer value */
-	void *notime_thread_ctx;		/* register thread data */
 #endif /* JENT_CONF_ENABLE_INTERNAL_TIMER */
 
-	uint64_t jent_common_timer_gcd;	/* Common divisor for all time deltas */
+#ifdef JENT_CONF_TIMER_REPLAY
+	uint64_t replay_time;			/* replayed time stamp */
+	size_t replay_pos;			/* next time delta in trace */
+#endif /* JENT_CONF_TIMER_REPLAY */
 
 #ifdef JENT_HEALTH_LAG_PREDICTOR
 	/* Lag predictor test to look for re-occurring patterns. */
@@ -299,6 +481,33 @@ struct rand_data
 	/* The scoreboard that tracks how successful each predictor lag is. */
 	unsigned int lag_scoreboard[JENT_LAG_HISTORY_SIZE];
 #endif /* JENT_HEALTH_LAG_PREDICTOR */
+
+	/*
+	 * Cold data: only used when allocating, configuring and releasing
+	 * the entropy collector.
+	 */
+	unsigned int flags;		/* Flags used to initialize */
+	uint32_t memsize;		/* Size of *mem in bytes */
+	size_t inplace_size;		/* Size of the caller-supplied memory
+					 * holding the collector, 0 if it is
+					 * allocated */
+
+#ifdef JENT_CONF_ENABLE_INTERNAL_TIMER
+	void *notime_thread_ctx;		/* register thread data */
+
+	/*
+	 * Data shared with the timer thread: the counter is written
+	 * continuously by the timer thread executing on another CPU. The
+	 * padding places it on a cache line of its own independent of the
+	 * alignment of the structure such that the cache lines holding the
+	 * hot data are not invalidated with every tick.
+	 */
+	uint8_t notime_pad_pre[JENT_CACHELINE_SIZE];
+	volatile uint64_t notime_timer;		/* high-res timer mock-up */
+	volatile uint8_t notime_interrupt;	/* indicator to interrupt ctr */
+	uint8_t notime_pad_post[JENT_CACHELINE_SIZE - sizeof(uint64_t) -
+				sizeof(uint8_t)];
+#endif /* JENT_CONF_ENABLE_INTERNAL_TIMER */
 };
 
 /* Flags that can be used to initialize the RNG */
@@ -314,6 +523,30 @@ struct rand_data
 #define JENT_FORCE_FIPS (1<<5)		  /* Force FIPS compliant mode
 					     including full SP800-90B
 					     compliance. */
+#define JENT_SELECT_TIMER (1<<6)	  /* Select the time stamp source
+					     with the highest entropy rate
+					     during initialization. */
+#define JENT_NOTIME_SHARED (1<<7)	  /* Use one internal timer thread
+					     shared by all entropy
+					     collectors. */
+#define JENT_NOTIME_WAIT_SPIN (1<<8)	  /* Busy-wait for the internal
+					     timer to advance. */
+#define JENT_NOTIME_WAIT_BOUNDED (1<<9)	  /* Busy-wait for the internal
+					     timer to advance for a limited
+					     time before yielding the CPU. */
+#define JENT_CONDITIONING_SHA3_512 (1<<10) /* Use SHA3-512 as conditioning
+					      function generating 512 bit
+					      blocks. */
+#define JENT_ONLINE_ESTIMATOR (1<<11)	  /* Estimate the min-entropy of the
+					     time deltas at runtime, see
+					     jent_entropy_estimate. */
+#define JENT_MEMACCESS_MULTISTREAM (1<<12) /* EXPERIMENTAL: Interleave
+					      independent memory access
+					      streams. */
+#define JENT_MEMACCESS_SEQUENTIAL (1<<13) /* Access the memory sequentially
+					     with a fixed stride. */
+#define JENT_MEMACCESS_RANDOM (1<<14)	  /* Access the memory at random
+					     locations. */
 
 /* Flags field limiting the amount of memory to be used for memory access */
 #define JENT_FLAGS_TO_MEMSIZE_SHIFT	28
@@ -375,6 +608,9 @@ JENT_PRIVATE_STATIC
 ssize_t jent_read_entropy(struct rand_data *ec, char *data, size_t len);
 JENT_PRIVATE_STATIC
 ssize_t jent_read_entropy_safe(struct rand_data **ec, char *data, size_t len);
+JENT_PRIVATE_STATIC
+ssize_t jent_read_entropy_multi(struct rand_data **ec, char **data, size_t len,
+				unsigned int num);
 /* initialize an instance of the entropy collector */
 JENT_PRIVATE_STATIC
 struct rand_data *jent_entropy_collector_alloc(unsigned int osr,
@@ -383,6 +619,17 @@ struct rand_data *jent_entropy_collector_alloc(unsigned int osr,
 JENT_PRIVATE_STATIC
 void jent_entropy_collector_free(struct rand_data *entropy_collector);
 
+/* initialize an instance of the entropy collector in caller-supplied memory */
+JENT_PRIVATE_STATIC
+size_t jent_entropy_collector_size(unsigned int flags);
+JENT_PRIVATE_STATIC
+struct rand_data *jent_entropy_collector_init_inplace(void *buf, size_t len,
+						      unsigned int osr,
+						      unsigned int flags);
+/* clearing of entropy collector in caller-supplied memory */
+JENT_PRIVATE_STATIC
+void jent_entropy_collector_fini_inplace(struct rand_data *entropy_collector);
+
 /* initialization of entropy collector */
 JENT_PRIVATE_STATIC
 int jent_entropy_init(void);
@@ -406,6 +653,75 @@ unsigned int jent_version(void);
 JENT_PRIVATE_STATIC
 int jent_entropy_switch_notime_impl(struct jent_notime_thread *new_thread);
 
+/* Set a different high-resolution time stamp source */
+JENT_PRIVATE_STATIC
+int jent_entropy_switch_timer_impl(jent_timer_read_cb new_timer);
+
+/* Replay a recorded trace of time deltas instead of reading a time stamp */
+JENT_PRIVATE_STATIC
+int jent_entropy_switch_timer_replay(const uint64_t *trace, size_t num);
+
+/* Register an auxiliary noise source executed before each time stamp */
+JENT_PRIVATE_STATIC
+int jent_entropy_register_noise_source(const struct jent_noise_source *src);
+
+/* Obtain entropy for a list of buffers in one request */
+JENT_PRIVATE_STATIC
+ssize_t jent_read_entropy_iov(struct rand_data *ec, const struct iovec *iov,
+			      int iovcnt);
+
+/* Incremental entropy collection */
+JENT_PRIVATE_STATIC
+int jent_collect_step(struct rand_data *ec, unsigned int max_measurements);
+JENT_PRIVATE_STATIC
+int jent_collect_ready(struct rand_data *ec);
+JENT_PRIVATE_STATIC
+ssize_t jent_collect_take(struct rand_data *ec, char *data, size_t len);
+
+/*
+ * Background entropy generation: an entropy collector operated by a
+ * background thread fills a buffer of size bytes. The file descriptor
+ * returned by jent_background_fd becomes readable once at least threshold
+ * bytes are available and can be used with poll/epoll.
+ */
+struct jent_background;
+JENT_PRIVATE_STATIC
+struct jent_background *jent_background_alloc(unsigned int osr,
+					      unsigned int flags,
+					      size_t size, size_t threshold);
+JENT_PRIVATE_STATIC
+void jent_background_free(struct jent_background *bg);
+JENT_PRIVATE_STATIC
+int jent_background_fd(struct jent_background *bg);
+JENT_PRIVATE_STATIC
+ssize_t jent_background_read(struct jent_background *bg, char *data,
+			     size_t len);
+
+/*
+ * Thread-local entropy collector: allocated with the configured osr and
+ * flags on the first request of a thread and freed at thread exit.
+ */
+JENT_PRIVATE_STATIC
+int jent_entropy_tls_config(unsigned int osr, unsigned int flags);
+JENT_PRIVATE_STATIC
+ssize_t jent_read_entropy_tls(char *data, size_t len);
+JENT_PRIVATE_STATIC
+void jent_entropy_tls_free(void);
+
+/* Result of the online entropy estimator */
+JENT_PRIVATE_STATIC
+int jent_entropy_estimate(struct rand_data *ec,
+			  struct jent_entropy_estimate *estimate);
+
+/* Search the cheapest configuration meeting the required entropy */
+JENT_PRIVATE_STATIC
+int jent_autotune(unsigned int flags, unsigned int margin,
+		  struct jent_autotune_stat stat[JENT_AUTOTUNE_MAX]);
+
+/* Result of the time stamp source selection */
+JENT_PRIVATE_STATIC
+int jent_timer_selection(struct jent_timer_stat stat[JENT_TIMER_SRC_MAX]);
+
 /* -- END of Main interface functions -- */
 
 /* -- BEGIN timer-less threading support functions to prevent code dupes -- */
@@ -447,6 +763,7 @@ static inline void jent_notime_fini(void *ctx) { (void)ctx; }
 #define EHASH		11 /* Hash self test failed */
 #define EMEM		12 /* Can't allocate memory for initialization */
 #define EGCD		13 /* GCD self-test failed */
+#define EESTIMATOR	14 /* Entropy estimator self-test failed */
 /* -- END error codes for init function -- */
 
 /* -- BEGIN error masks for health tests -- */
@@ -0,0 +1,178 @@
+/* Jitter RNG: Entropy per CPU time autotuner
+ *
+ * Copyright (C) 2022, Stephan Mueller <smueller@chronox.de>
+ *
+ * License: see LICENSE file in root directory
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "jitterentropy.h"
+
+#include "jitterentropy-estimator.h"
+#include "jitterentropy-health.h"
+#include "jitterentropy-noise.h"
+#include "jitterentropy-timer.h"
+
+/***************************************************************************
+ * Autotuner
+ *
+ * The cost of one random block is the number of time deltas required for
+ * it, (block size + safety factor) * osr, times the wall time of one time
+ * delta. Both the wall time and the min-entropy per time delta depend on the
+ * size of the memory access buffer. For every memory access buffer size, a
+ * short recording evaluated by the online entropy estimator determines the
+ * min-entropy per time delta, from which the smallest oversampling rate
+ * meeting the requested margin follows. The setting with the cheapest
+ * random block is recommended.
+ *
+ * The oversampling rate is never lowered below JENT_MIN_OSR, i.e. the
+ * default: the search can only raise it if the estimate requires this.
+ *
+ * Disabling the memory access is not evaluated: the short recording is no
+ * assessment that would justify dropping a noise source. The loop counts of
+ * the hash and memory access operations are constants of the assessed noise
+ * source and therefore not part of the search either.
+ ***************************************************************************/
+
+/* Number of estimator windows recorded per setting */
+#define JENT_AUTOTUNE_WINDOWS	2
+
+static void jent_autotune_setting(struct rand_data *ec, unsigned int margin,
+				  struct jent_autotune_stat *stat)
+{
+	struct jent_entropy_estimate est;
+	uint64_t start, end, need;
+	unsigned int i, j, safety_factor = 0;
+
+	stat->min_entropy = UINT32_MAX;
+
+	if (jent_notime_settick(ec)) {
+		stat->ret = ENOTIME;
+		return;
+	}
+
+	jent_timer_walltime(&start);
+
+	/* priming of the ->prev_time value */
+	jent_measure_jitter(ec, 0, NULL);
+
+	for (i = 0; i < JENT_AUTOTUNE_WINDOWS; i++) {
+		for (j = 0; j < JENT_ESTIMATOR_WINDOW; j++)
+			jent_measure_jitter(ec, 0, NULL);
+
+		if (jent_health_failure(ec))
+			break;
+
+		if (!jent_estimator_get(ec, &est) &&
+		    est.min_entropy < stat->min_entropy)
+			stat->min_entropy = est.min_entropy;
+	}
+
+	jent_timer_walltime(&end);
+
+	jent_notime_unsettick(ec);
+
+	if (jent_health_failure(ec) || !stat->min_entropy ||
+	    stat->min_entropy == UINT32_MAX) {
+		stat->ret = EHEALTH;
+		return;
+	}
+
+	/*
+	 * min_entropy * osr must exceed 1 bit by the margin in percent, the
+	 * default oversampling rate is kept if it suffices.
+	 */
+	need = (uint64_t)1000 * (100 + margin) / 100;
+	stat->osr = (unsigned int)((need + stat->min_entropy - 1) /
+				   stat->min_entropy);
+	if (stat->osr < JENT_MIN_OSR)
+		stat->osr = JENT_MIN_OSR;
+
+	if (ec->fips_enabled)
+		safety_factor = ENTROPY_SAFETY_FACTOR;
+
+	stat->sample_ns = (end - start) /
+			  ((uint64_t)JENT_AUTOTUNE_WINDOWS *
+			   JENT_ESTIMATOR_WINDOW + 1);
+	stat->block_ns = stat->sample_ns *
+			 (jent_data_size_bits(ec) + safety_factor) * stat->osr;
+	stat->ret = 0;
+}
+
+/*
+ * Evaluate all maximum memory sizes up to the one given with flags (or the
+ * size limited by the cache size) and return the index of the cheapest
+ * setting in stat or -ENODEV if no setting is usable. Index 0 is not
+ * evaluated.
+ */
+JENT_PRIVATE_STATIC
+int jent_autotune(unsigned int flags, unsigned int margin,
+		  struct jent_autotune_stat stat[JENT_AUTOTUNE_MAX])
+{
+	unsigned int base, max, i;
+	uint32_t prev_memsize = 0;
+	int best = -ENODEV;
+
+	if (!stat)
+		return -EINVAL;
+
+	max = JENT_FLAGS_TO_MAX_MEMSIZE(flags);
+	if (!max)
+		max = JENT_FLAGS_TO_MAX_MEMSIZE(JENT_MAX_MEMSIZE_MAX);
+	base = flags & ~(JENT_MAX_MEMSIZE_MASK | JENT_DISABLE_MEMORY_ACCESS);
+
+	for (i = 0; i < JENT_AUTOTUNE_MAX; i++) {
+		struct rand_data *ec;
+
+		memset(&stat[i], 0, sizeof(stat[i]));
+		stat[i].ret = ENOTIME;
+
+		/* Index 0 would disable the memory access */
+		if (!i || i > max)
+			continue;
+
+		stat[i].flags = base | JENT_MAX_MEMSIZE_TO_FLAGS(i);
+		ec = jent_entropy_collector_alloc(0, stat[i].flags |
+						     JENT_ONLINE_ESTIMATOR);
+		if (!ec) {
+			stat[i].ret = EMEM;
+			continue;
+		}
+		stat[i].memsize = ec->memsize;
+
+		/*
+		 * The memory size is limited by the cache size: once a larger
+		 * maximum does not increase it, all remaining settings are
+		 * identical and need no recording.
+		 */
+		if (stat[i].memsize == prev_memsize) {
+			jent_entropy_collector_free(ec);
+			max = i;
+			continue;
+		}
+		prev_memsize = stat[i].memsize;
+
+		jent_autotune_setting(ec, margin, &stat[i]);
+		jent_entropy_collector_free(ec);
+
+		if (stat[i].ret)
+			continue;
+
+		if (best < 0 || stat[i].block_ns < stat[best].block_ns)
+			best = (int)i;
+	}
+
+	return best;
+}
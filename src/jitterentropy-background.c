@@ -0,0 +1,366 @@
+/* Jitter RNG: Background entropy generation with readiness notification
+ *
+ * Copyright (C) 2022, Stephan Mueller <smueller@chronox.de>
+ *
+ * License: see LICENSE file in root directory
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "jitterentropy.h"
+
+#include "jitterentropy-health.h"
+#include "jitterentropy-noise.h"
+#include "jitterentropy-timer.h"
+
+#ifdef JENT_CONF_ENABLE_THREADS
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+/***************************************************************************
+ * Background entropy generation
+ *
+ * An entropy collector is operated by a background thread that fills a
+ * buffer with random data. Once the buffer holds at least the threshold
+ * of bytes, the caller is notified via a file descriptor becoming readable
+ * which can be registered with poll/epoll. On Linux an eventfd is used,
+ * otherwise a pipe.
+ ***************************************************************************/
+
+struct jent_background {
+	struct rand_data *ec;		/* Collector owned by the thread */
+	pthread_t thread;
+	pthread_mutex_t lock;		/* Protects the fields below */
+	pthread_cond_t cond;		/* Wake up the thread to refill */
+
+	uint8_t *buf;			/* Buffer of random data */
+	size_t size;			/* Size of buf in bytes */
+	size_t fill;			/* Random bytes in buf */
+	size_t threshold;		/* Signal readiness above this fill */
+
+	int rfd;			/* Readiness file descriptor */
+	int wfd;			/* Writing end of the notification */
+	int signaled;			/* Readiness is signaled */
+	int error;			/* Permanent error of the collector */
+	int stop;			/* Terminate the thread */
+};
+
+static int jent_background_notify_init(struct jent_background *bg)
+{
+#ifdef __linux__
+	bg->rfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (bg->rfd < 0)
+		return -errno;
+	bg->wfd = bg->rfd;
+#else /* __linux__ */
+	int fds[2], i;
+
+	if (pipe(fds))
+		return -errno;
+
+	for (i = 0; i < 2; i++) {
+		if (fcntl(fds[i], F_SETFL, O_NONBLOCK) ||
+		    fcntl(fds[i], F_SETFD, FD_CLOEXEC)) {
+			close(fds[0]);
+			close(fds[1]);
+			return -errno;
+		}
+	}
+
+	bg->rfd = fds[0];
+	bg->wfd = fds[1];
+#endif /* __linux__ */
+
+	return 0;
+}
+
+static void jent_background_notify_fini(struct jent_background *bg)
+{
+	if (bg->rfd >= 0)
+		close(bg->rfd);
+	if (bg->wfd >= 0 && bg->wfd != bg->rfd)
+		close(bg->wfd);
+}
+
+/* Caller must hold bg->lock */
+static void jent_background_notify_set(struct jent_background *bg)
+{
+	uint64_t val = 1;
+	ssize_t ret;
+
+	if (bg->signaled)
+		return;
+
+	ret = write(bg->wfd, &val, sizeof(val));
+	(void)ret;
+	bg->signaled = 1;
+}
+
+/* Caller must hold bg->lock */
+static void jent_background_notify_clear(struct jent_background *bg)
+{
+	uint64_t val;
+
+	if (!bg->signaled)
+		return;
+
+	while (read(bg->rfd, &val, sizeof(val)) > 0)
+		;
+	bg->signaled = 0;
+}
+
+static void *jent_background_fill(void *arg)
+{
+	struct jent_background *bg = (struct jent_background *)arg;
+	struct rand_data *ec = bg->ec;
+	uint8_t jent_block[DATA_SIZE_BITS_MAX / 8];
+	size_t blocksize = jent_data_size_bits(ec) / 8;
+	unsigned int health_test_result;
+	int ticking = 0;
+
+	pthread_mutex_lock(&bg->lock);
+
+	while (!bg->stop) {
+		size_t tocopy;
+
+		if (bg->fill >= bg->size) {
+			/*
+			 * Buffer is full: apply the enhanced backtracking
+			 * protection as done by jent_read_entropy at the end
+			 * of a request and sleep until data is consumed.
+			 */
+			if (ticking) {
+				jent_read_random_block(ec, NULL, 0);
+				jent_notime_unsettick(ec);
+				ticking = 0;
+			}
+
+			pthread_cond_wait(&bg->cond, &bg->lock);
+			continue;
+		}
+
+		pthread_mutex_unlock(&bg->lock);
+
+		if (!ticking) {
+			if (jent_notime_settick(ec)) {
+				pthread_mutex_lock(&bg->lock);
+				bg->error = -4;
+				break;
+			}
+			ticking = 1;
+		}
+
+		jent_random_data(ec);
+
+		if ((health_test_result = jent_health_failure(ec))) {
+			pthread_mutex_lock(&bg->lock);
+			bg->error =
+				jent_health_failure_errcode(health_test_result);
+			break;
+		}
+
+		jent_read_random_block(ec, (char *)jent_block, blocksize);
+
+		pthread_mutex_lock(&bg->lock);
+
+		tocopy = bg->size - bg->fill;
+		if (tocopy > blocksize)
+			tocopy = blocksize;
+		memcpy(bg->buf + bg->fill, jent_block, tocopy);
+		bg->fill += tocopy;
+
+		if (bg->fill >= bg->threshold)
+			jent_background_notify_set(bg);
+	}
+
+	/* Wake up the caller to report the error */
+	if (bg->error)
+		jent_background_notify_set(bg);
+
+	pthread_mutex_unlock(&bg->lock);
+
+	if (ticking)
+		jent_notime_unsettick(ec);
+
+	jent_memset_secure(jent_block, sizeof(jent_block));
+
+	return NULL;
+}
+
+JENT_PRIVATE_STATIC
+void jent_background_free(struct jent_background *bg)
+{
+	if (!bg)
+		return;
+
+	pthread_mutex_lock(&bg->lock);
+	bg->stop = 1;
+	pthread_cond_signal(&bg->cond);
+	pthread_mutex_unlock(&bg->lock);
+
+	pthread_join(bg->thread, NULL);
+
+	jent_background_notify_fini(bg);
+	pthread_cond_destroy(&bg->cond);
+	pthread_mutex_destroy(&bg->lock);
+	jent_entropy_collector_free(bg->ec);
+	jent_zfree(bg->buf, (unsigned int)bg->size);
+	jent_zfree(bg, sizeof(struct jent_background));
+}
+
+JENT_PRIVATE_STATIC
+struct jent_background *jent_background_alloc(unsigned int osr,
+					      unsigned int flags,
+					      size_t size, size_t threshold)
+{
+	struct jent_background *bg;
+
+	if (!size || size > UINT_MAX || !threshold || threshold > size)
+		return NULL;
+
+	bg = jent_zalloc(sizeof(struct jent_background));
+	if (!bg)
+		return NULL;
+
+	bg->rfd = -1;
+	bg->wfd = -1;
+	bg->size = size;
+	bg->threshold = threshold;
+
+	bg->buf = jent_zalloc(size);
+	if (!bg->buf)
+		goto err;
+
+	bg->ec = jent_entropy_collector_alloc(osr, flags);
+	if (!bg->ec)
+		goto err;
+
+	if (jent_background_notify_init(bg))
+		goto err;
+
+	if (pthread_mutex_init(&bg->lock, NULL))
+		goto err;
+
+	if (pthread_cond_init(&bg->cond, NULL)) {
+		pthread_mutex_destroy(&bg->lock);
+		goto err;
+	}
+
+	if (pthread_create(&bg->thread, NULL, jent_background_fill, bg)) {
+		pthread_cond_destroy(&bg->cond);
+		pthread_mutex_destroy(&bg->lock);
+		goto err;
+	}
+
+	return bg;
+
+err:
+	jent_background_notify_fini(bg);
+	jent_entropy_collector_free(bg->ec);
+	if (bg->buf)
+		jent_zfree(bg->buf, (unsigned int)size);
+	jent_zfree(bg, sizeof(struct jent_background));
+	return NULL;
+}
+
+JENT_PRIVATE_STATIC
+int jent_background_fd(struct jent_background *bg)
+{
+	if (!bg)
+		return -EINVAL;
+
+	return bg->rfd;
+}
+
+JENT_PRIVATE_STATIC
+ssize_t jent_background_read(struct jent_background *bg, char *data,
+			     size_t len)
+{
+	ssize_t ret;
+	size_t tocopy;
+
+	if (!bg)
+		return -1;
+
+	pthread_mutex_lock(&bg->lock);
+
+	if (bg->error) {
+		ret = bg->error;
+		goto out;
+	}
+
+	if (!bg->fill) {
+		ret = -EAGAIN;
+		goto out;
+	}
+
+	tocopy = (len < bg->fill) ? len : bg->fill;
+	memcpy(data, bg->buf, tocopy);
+	memmove(bg->buf, bg->buf + tocopy, bg->fill - tocopy);
+	jent_memset_secure(bg->buf + bg->fill - tocopy, tocopy);
+	bg->fill -= tocopy;
+
+	if (bg->fill < bg->threshold)
+		jent_background_notify_clear(bg);
+
+	/* Refill the buffer */
+	pthread_cond_signal(&bg->cond);
+
+	ret = (ssize_t)tocopy;
+
+out:
+	pthread_mutex_unlock(&bg->lock);
+	return ret;
+}
+
+#else /* JENT_CONF_ENABLE_THREADS */
+
+JENT_PRIVATE_STATIC
+struct jent_background *jent_background_alloc(unsigned int osr,
+					      unsigned int flags,
+					      size_t size, size_t threshold)
+{
+	(void)osr;
+	(void)flags;
+	(void)size;
+	(void)threshold;
+	return NULL;
+}
+
+JENT_PRIVATE_STATIC
+void jent_background_free(struct jent_background *bg)
+{
+	(void)bg;
+}
+
+JENT_PRIVATE_STATIC
+int jent_background_fd(struct jent_background *bg)
+{
+	(void)bg;
+	return -EOPNOTSUPP;
+}
+
+JENT_PRIVATE_STATIC
+ssize_t jent_background_read(struct jent_background *bg, char *data,
+			     size_t len)
+{
+	(void)bg;
+	(void)data;
+	(void)len;
+	return -EOPNOTSUPP;
+}
+
+#endif /* JENT_CONF_ENABLE_THREADS */
@@ -32,6 +32,8 @@
 #include "jitterentropy.h"
 
 #include "jitterentropy-base.h"
+#include "jitterentropy-cache.h"
+#include "jitterentropy-estimator.h"
 #include "jitterentropy-gcd.h"
 #include "jitterentropy-health.h"
 #include "jitterentropy-noise.h"
@@ -42,10 +44,10 @@
 		      * require consumer to be updated (as long as this number
 		      * is zero, the API is not considered stable and can
 		      * change without a bump of the major version) */
-#define MINVERSION 4 /* API compatible, ABI may change, functional
+#define MINVERSION 5 /* API compatible, ABI may change, functional
 		      * enhancements only, consumer can be left unchanged if
 		      * enhancements are not considered */
-#define PATCHLEVEL 1 /* API / ABI compatible, no functional changes, no
+#define PATCHLEVEL 0 /* API / ABI compatible, no functional changes, no
 		      * enhancements, bug fixes only */
 
 /***************************************************************************
@@ -186,18 +188,12 @@ ssize_t jent_read_entropy(struct rand_data *ec, char *data, size_t len)
 		jent_random_data(ec);
 
 		if ((health_test_result = jent_health_failure(ec))) {
-			if (health_test_result & JENT_RCT_FAILURE)
-				ret = -2;
-			else if (health_test_result & JENT_APT_FAILURE)
-				ret = -3;
-			else
-				ret = -5;
-
+			ret = jent_health_failure_errcode(health_test_result);
 			goto err;
 		}
 
-		if ((DATA_SIZE_BITS / 8) < len)
-			tocopy = (DATA_SIZE_BITS / 8);
+		if ((jent_data_size_bits(ec) / 8) < len)
+			tocopy = (jent_data_size_bits(ec) / 8);
 		else
 			tocopy = len;
 
@@ -239,6 +235,233 @@ err:
 	return ret ? ret : (ssize_t)orig_len;
 }
 
+/**
+ * Entry function: Advance the entropy collection incrementally.
+ *
+ * This function performs at most max_measurements measurements of the noise
+ * source and returns. Repeated invocations continue the collection where the
+ * previous one stopped until enough measurements for one random block are
+ * gathered. This allows the entropy collection to be interleaved with other
+ * work, e.g. in single-threaded event loops. When the internal timer is used,
+ * its timer thread is started with the first step and keeps running until
+ * jent_collect_take (or an entropy collector free) to avoid the thread
+ * creation for every step.
+ *
+ * @ec [in] Reference to entropy collector
+ * @max_measurements [in] Maximum number of measurements to perform
+ *
+ * @return number of measurements still required before jent_collect_take
+ *	   can be invoked, 0 if a random block is ready
+ *	  -1	entropy_collector is NULL
+ *	  -2	RCT failed
+ *	  -3	APT test failed
+ *	  -4	The timer cannot be initialized
+ *	  -5	LAG failure
+ */
+JENT_PRIVATE_STATIC
+int jent_collect_step(struct rand_data *ec, unsigned int max_measurements)
+{
+	unsigned int remaining, health_test_result;
+
+	if (NULL == ec)
+		return -1;
+
+	if (jent_notime_settick(ec))
+		return -4;
+
+	remaining = jent_random_data_step(ec, max_measurements);
+
+	if ((health_test_result = jent_health_failure(ec))) {
+		jent_notime_unsettick(ec);
+		return jent_health_failure_errcode(health_test_result);
+	}
+
+	return (remaining > INT_MAX) ? INT_MAX : (int)remaining;
+}
+
+/**
+ * Entry function: Is a random block available from the incremental
+ * collection?
+ *
+ * @ec [in] Reference to entropy collector
+ *
+ * @return 1 if jent_collect_take returns data, 0 otherwise
+ */
+JENT_PRIVATE_STATIC
+int jent_collect_ready(struct rand_data *ec)
+{
+	if (NULL == ec || jent_health_failure(ec))
+		return 0;
+
+	return !jent_random_data_remaining(ec);
+}
+
+/**
+ * Entry function: Obtain the random block from the incremental collection.
+ *
+ * One random block of the conditioning function's digest size is generated
+ * from the measurements gathered with jent_collect_step. If the caller
+ * requests more data, only one block is returned and the next block must be
+ * collected first.
+ *
+ * @ec [in] Reference to entropy collector
+ * @data [out] pointer to buffer for storing random data -- buffer must
+ *	       already exist
+ * @len [in] size of the buffer
+ *
+ * @return number of bytes returned when request is fulfilled or an error
+ *	  -EAGAIN	no random block is ready
+ *	  -1		entropy_collector is NULL
+ *	  -2		RCT failed
+ *	  -3		APT test failed
+ *	  -5		LAG failure
+ */
+JENT_PRIVATE_STATIC
+ssize_t jent_collect_take(struct rand_data *ec, char *data, size_t len)
+{
+	unsigned int health_test_result;
+
+	if (NULL == ec)
+		return -1;
+
+	if ((health_test_result = jent_health_failure(ec)))
+		return jent_health_failure_errcode(health_test_result);
+
+	if (jent_random_data_remaining(ec))
+		return -EAGAIN;
+
+	/* Stop the timer thread started by jent_collect_step */
+	jent_notime_unsettick(ec);
+
+	if ((jent_data_size_bits(ec) / 8) < len)
+		len = (jent_data_size_bits(ec) / 8);
+
+	jent_read_random_block(ec, data, len);
+
+	/* Enhanced backtracking support, see jent_read_entropy */
+#ifndef CONFIG_CRYPTO_CPU_JITTERENTROPY_SECURE_MEMORY
+	jent_read_random_block(ec, NULL, 0);
+#endif
+
+	return (ssize_t)len;
+}
+
+/**
+ * Entry function: Obtain entropy for a list of buffers.
+ *
+ * This function fills all buffers of the list as if one request of the
+ * combined length was processed by jent_read_entropy(): the random data is
+ * generated as one continuous stream where random blocks are not reused
+ * across buffers. Yet, the internal timer is started and stopped only once
+ * and the final backtracking protection is applied only once for the entire
+ * list. This is the preferred interface for many small requests issued
+ * back-to-back.
+ *
+ * @ec [in] Reference to entropy collector
+ * @iov [in] Array of buffers to be filled with random data
+ * @iovcnt [in] Number of buffers in iov
+ *
+ * @return number of bytes returned when request is fulfilled or an error
+ *	   as documented for jent_read_entropy
+ */
+JENT_PRIVATE_STATIC
+ssize_t jent_read_entropy_iov(struct rand_data *ec, const struct iovec *iov,
+			      int iovcnt)
+{
+	uint8_t jent_block[DATA_SIZE_BITS_MAX / 8];
+	size_t blocksize, avail = 0, total = 0;
+	int i, ret = 0;
+
+	if (NULL == ec || iovcnt < 0 || (!iov && iovcnt))
+		return -1;
+
+	if (jent_notime_settick(ec))
+		return -4;
+
+	blocksize = jent_data_size_bits(ec) / 8;
+
+	for (i = 0; i < iovcnt; i++) {
+		uint8_t *p = (uint8_t *)iov[i].iov_base;
+		size_t len = iov[i].iov_len;
+
+		while (len > 0) {
+			size_t tocopy;
+
+			if (!avail) {
+				unsigned int health_test_result;
+
+				jent_random_data(ec);
+
+				if ((health_test_result =
+				     jent_health_failure(ec))) {
+					ret = jent_health_failure_errcode(
+							health_test_result);
+					goto err;
+				}
+
+				jent_read_random_block(ec, (char *)jent_block,
+						       blocksize);
+				avail = blocksize;
+			}
+
+			tocopy = (avail < len) ? avail : len;
+			memcpy(p, jent_block + blocksize - avail, tocopy);
+
+			avail -= tocopy;
+			len -= tocopy;
+			p += tocopy;
+			total += tocopy;
+		}
+	}
+
+	/* Enhanced backtracking support, see jent_read_entropy */
+#ifndef CONFIG_CRYPTO_CPU_JITTERENTROPY_SECURE_MEMORY
+	jent_read_random_block(ec, NULL, 0);
+#endif
+
+err:
+	jent_memset_secure(jent_block, sizeof(jent_block));
+	jent_notime_unsettick(ec);
+	return ret ? ret : (ssize_t)total;
+}
+
+/**
+ * Entry function: Obtain entropy from multiple entropy collectors.
+ *
+ * This function fills one buffer per entropy collector the same way as
+ * jent_read_entropy() does. The entropy collectors are processed one after
+ * the other.
+ *
+ * @ec [in] Array of num references to entropy collectors
+ * @data [out] Array of num pointers to buffers for storing random data --
+ *	       every buffer must already exist and must be at least len bytes
+ * @len [in] size of every buffer, specifying also the requested number of
+ *	     random bytes per entropy collector
+ * @num [in] number of entropy collectors and buffers
+ *
+ * @return len when all requests are fulfilled or an error as documented for
+ *	   jent_read_entropy(). In case of an error, the content of all buffers
+ *	   is undefined.
+ */
+JENT_PRIVATE_STATIC
+ssize_t jent_read_entropy_multi(struct rand_data **ec, char **data, size_t len,
+				unsigned int num)
+{
+	unsigned int i;
+
+	if (!ec || !data)
+		return -1;
+
+	for (i = 0; i < num; i++) {
+		ssize_t ret = jent_read_entropy(ec[i], data[i], len);
+
+		if (ret < 0)
+			return ret;
+	}
+
+	return (ssize_t)len;
+}
+
 static struct rand_data *_jent_entropy_collector_alloc(unsigned int osr,
 						       unsigned int flags);
 
@@ -257,7 +480,9 @@ static struct rand_data *_jent_entropy_collector_alloc(unsigned int osr,
  * is not safe to be used on the current system.
  *
  * @ec [in] Reference to entropy collector - this is a double pointer as
- *	    The entropy collector may be freed and reallocated.
+ *	    The entropy collector may be freed and reallocated. An entropy
+ *	    collector in caller-supplied memory is not reallocated, the health
+ *	    test failure is returned instead.
  * @data [out] pointer to buffer for storing random data -- buffer must
  *	       already exist
  * @len [in] size of the buffer, specifying also the requested number of random
@@ -295,6 +520,10 @@ ssize_t jent_read_entropy_safe(struct rand_data **ec, char *data, size_t len)
 			if (osr > 20)
 				return ret;
 
+			/* The caller owns the memory of the collector */
+			if ((*ec)->inplace_size)
+				return ret;
+
 			/*
 			 * If the caller did not set any specific maximum value
 			 * let the Jitter RNG increase the maximum memory by
@@ -308,6 +537,7 @@ ssize_t jent_read_entropy_safe(struct rand_data **ec, char *data, size_t len)
 			 * memory size
 			 */
 			jent_entropy_collector_free(*ec);
+			*ec = NULL;
 
 			/* Perform new health test with updated OSR */
 			if (jent_entropy_init_ex(osr, flags))
@@ -355,19 +585,26 @@ ssize_t jent_read_entropy_safe(struct rand_data **ec, char *data, size_t len)
  *
  * If the caller provides a maximum memory size, use
  * min(provided max memory, data cache size).
+ *
+ * The data cache size is the one of the core type the calling thread is
+ * allowed to execute on as defined by its CPU affinity. If a collector is
+ * pinned to one CPU or one core type before allocation, its memory is sized
+ * for that CPU. Otherwise the largest cache size of all allowed core types
+ * is used.
  */
-static inline uint32_t jent_memsize(unsigned int flags)
+static inline uint32_t jent_max_memsize(unsigned int flags)
 {
-	uint32_t memsize, max_memsize;
+	uint32_t max_memsize = JENT_FLAGS_TO_MAX_MEMSIZE(flags);
 
-	max_memsize = JENT_FLAGS_TO_MAX_MEMSIZE(flags);
+	if (max_memsize == 0)
+		return JENT_MEMORY_SIZE;
 
-	if (max_memsize == 0) {
-		max_memsize = JENT_MEMORY_SIZE;
-	} else {
-		max_memsize = UINT32_C(1) << (max_memsize +
-					      JENT_MAX_MEMSIZE_OFFSET);
-	}
+	return UINT32_C(1) << (max_memsize + JENT_MAX_MEMSIZE_OFFSET);
+}
+
+static inline uint32_t jent_memsize(unsigned int flags)
+{
+	uint32_t memsize, max_memsize = jent_max_memsize(flags);
 
 	/* Allocate memory for adding variations based on memory access */
 	memsize = jent_cache_size_roundup();
@@ -382,25 +619,104 @@ static inline uint32_t jent_memsize(unsigned int flags)
 	return memsize;
 }
 
-static int jent_selftest_run = 0;
+/*
+ * Global initialization state: the self tests are executed by one thread
+ * holding jent_init_lock while concurrent callers wait for it. Once the
+ * self tests passed, jent_selftest_passed allows allocations to proceed
+ * without taking the lock.
+ */
+static volatile int jent_init_locked = 0;
+static volatile int jent_selftest_passed = 0;
 
-static struct rand_data
-*jent_entropy_collector_alloc_internal(unsigned int osr, unsigned int flags)
+/* Number of allocated entropy collectors */
+static volatile int jent_collectors = 0;
+
+void jent_init_lock(void)
 {
-	struct rand_data *entropy_collector;
-	uint32_t memsize = 0;
+	while (jent_atomic_xchg(&jent_init_locked, 1)) {
+		while (jent_atomic_load(&jent_init_locked)) {
+			jent_cpu_relax();
+			jent_yield();
+		}
+	}
+}
+
+void jent_init_unlock(void)
+{
+	jent_atomic_store(&jent_init_locked, 0);
+}
+
+static int jent_entropy_init_ex_locked(unsigned int osr, unsigned int flags);
+
+/* Run the self tests unless they already passed */
+static int jent_entropy_init_once(unsigned int osr, unsigned int flags)
+{
+	int ret = 0;
+
+	if (jent_atomic_load(&jent_selftest_passed))
+		return 0;
+
+	jent_init_lock();
+	/* Another thread may have completed the self tests in the meantime */
+	if (!jent_atomic_load(&jent_selftest_passed))
+		ret = jent_entropy_init_ex_locked(osr, flags);
+	jent_init_unlock();
+
+	return ret;
+}
+
+/*
+ * Run the power-up test of the internal timer if it is requested with
+ * JENT_FORCE_INTERNAL_TIMER but was not selected during the initialization.
+ * It must be invoked without holding the init lock.
+ */
+static int jent_notime_init_once(unsigned int osr, unsigned int flags)
+{
+#ifdef JENT_CONF_ENABLE_INTERNAL_TIMER
+	int ret = 0;
+
+	if (!(flags & JENT_FORCE_INTERNAL_TIMER) || jent_notime_forced())
+		return 0;
+
+	jent_init_lock();
+	/* Another thread may have completed the power-up test meanwhile */
+	if (!jent_notime_forced()) {
+		ret = jent_time_entropy_init(osr,
+					     flags | JENT_FORCE_INTERNAL_TIMER);
+		/* Do not leave a failed internal timer in use */
+		if (ret)
+			jent_notime_unforce();
+	}
+	jent_init_unlock();
+
+	return ret ? EHEALTH : 0;
+#else
+	(void)osr;
+	(void)flags;
+	return 0;
+#endif
+}
 
+/* Check the flags for combinations that cannot be served */
+static int jent_entropy_collector_flags_invalid(unsigned int flags)
+{
 	/*
 	 * Requesting disabling and forcing of internal timer
 	 * makes no sense.
 	 */
 	if ((flags & JENT_DISABLE_INTERNAL_TIMER) &&
 	    (flags & JENT_FORCE_INTERNAL_TIMER))
-		return NULL;
+		return 1;
 
-	/* Force the self test to be run */
-	if (!jent_selftest_run && jent_entropy_init_ex(osr, flags))
-		return NULL;
+	/* Only one wait strategy for the internal timer can be used */
+	if ((flags & JENT_NOTIME_WAIT_SPIN) &&
+	    (flags & JENT_NOTIME_WAIT_BOUNDED))
+		return 1;
+
+	/* Only one memory access pattern can be used */
+	if ((flags & JENT_MEMACCESS_SEQUENTIAL) &&
+	    (flags & (JENT_MEMACCESS_RANDOM | JENT_MEMACCESS_MULTISTREAM)))
+		return 1;
 
 	/*
 	 * If the initial test code concludes to force the internal timer
@@ -408,43 +724,45 @@ static struct rand_data
 	 * the Jitter RNG instance.
 	 */
 	if (jent_notime_forced() && (flags & JENT_DISABLE_INTERNAL_TIMER))
-		return NULL;
+		return 1;
 
-	entropy_collector = jent_zalloc(sizeof(struct rand_data));
-	if (NULL == entropy_collector)
-		return NULL;
+	return 0;
+}
 
-	if (!(flags & JENT_DISABLE_MEMORY_ACCESS)) {
-		memsize = jent_memsize(flags);
-		entropy_collector->mem = (unsigned char *)jent_zalloc(memsize);
+/*
+ * Set up an entropy collector whose memory access buffer, hash state and
+ * estimator are already provided.
+ */
+static int jent_entropy_collector_setup(struct rand_data *entropy_collector,
+					unsigned int osr, unsigned int flags)
+{
+	if (entropy_collector->mem) {
+		uint32_t memsize = entropy_collector->memsize;
 
-#ifdef JENT_RANDOM_MEMACCESS
 		/*
-		 * Transform the size into a mask - it is assumed that size is
-		 * a power of 2.
+		 * Random memory access: transform the size into a mask - it is
+		 * assumed that size is a power of 2.
 		 */
 		entropy_collector->memmask = memsize - 1;
-#else /* JENT_RANDOM_MEMACCESS */
+
+		/* Sequential memory access */
 		entropy_collector->memblocksize = memsize / JENT_MEMORY_BLOCKS;
 		entropy_collector->memblocks = JENT_MEMORY_BLOCKS;
 
 		/* sanity check */
-		if (entropy_collector->memblocksize *
+		if (jent_memaccess_is_sequential(flags) &&
+		    entropy_collector->memblocksize *
 		    entropy_collector->memblocks != memsize)
-			goto err;
-
-#endif /* JENT_RANDOM_MEMACCESS */
+			return 1;
 
-		if (entropy_collector->mem == NULL)
-			goto err;
 		entropy_collector->memaccessloops = JENT_MEMORY_ACCESSLOOPS;
 	}
 
-	if (sha3_alloc(&entropy_collector->hash_state))
-		goto err;
-
 	/* Initialize the hash state */
-	sha3_256_init(entropy_collector->hash_state);
+	if (flags & JENT_CONDITIONING_SHA3_512)
+		sha3_512_init(entropy_collector->hash_state);
+	else
+		sha3_256_init(entropy_collector->hash_state);
 
 	/* verify and set the oversampling rate */
 	if (osr < JENT_MIN_OSR)
@@ -477,34 +795,89 @@ static struct rand_data
 	 */
 	if (!(flags & JENT_DISABLE_INTERNAL_TIMER)) {
 		if (jent_notime_enable(entropy_collector, flags))
+			return 1;
+	}
+
+	/* Select the noise source variant for the configured features */
+	jent_noise_select(entropy_collector);
+
+	return 0;
+}
+
+static struct rand_data
+*jent_entropy_collector_alloc_internal(unsigned int osr, unsigned int flags)
+{
+	struct rand_data *entropy_collector;
+	uint32_t memsize = 0;
+
+	if (jent_entropy_collector_flags_invalid(flags))
+		return NULL;
+
+	entropy_collector = jent_zalloc(sizeof(struct rand_data));
+	if (NULL == entropy_collector)
+		return NULL;
+
+	if (!(flags & JENT_DISABLE_MEMORY_ACCESS)) {
+		memsize = jent_memsize(flags);
+		entropy_collector->mem = (unsigned char *)jent_zalloc(memsize);
+		if (entropy_collector->mem == NULL)
 			goto err;
+		entropy_collector->memsize = memsize;
 	}
 
+	if (sha3_alloc(&entropy_collector->hash_state))
+		goto err;
+
+	if ((flags & JENT_ONLINE_ESTIMATOR) &&
+	    jent_estimator_alloc(entropy_collector))
+		goto err;
+
+	if (jent_entropy_collector_setup(entropy_collector, osr, flags))
+		goto err;
+
+	jent_atomic_add(&jent_collectors, 1);
+
 	return entropy_collector;
 
 err:
+	jent_estimator_free(entropy_collector);
+	if (entropy_collector->hash_state != NULL)
+		sha3_dealloc(entropy_collector->hash_state);
 	if (entropy_collector->mem != NULL)
 		jent_zfree(entropy_collector->mem, memsize);
 	jent_zfree(entropy_collector, sizeof(struct rand_data));
 	return NULL;
 }
 
+/* Fill the data pad with non-zero values */
+static int jent_entropy_collector_prime(struct rand_data *ec)
+{
+	if (jent_notime_settick(ec))
+		return 1;
+	jent_random_data(ec);
+	jent_notime_unsettick(ec);
+
+	return 0;
+}
+
 static struct rand_data *_jent_entropy_collector_alloc(unsigned int osr,
 						       unsigned int flags)
 {
-	struct rand_data *ec = jent_entropy_collector_alloc_internal(osr,
-								     flags);
+	struct rand_data *ec;
 
+	/* Force the self test to be run */
+	if (jent_entropy_init_once(osr, flags) ||
+	    jent_notime_init_once(osr, flags))
+		return NULL;
+
+	ec = jent_entropy_collector_alloc_internal(osr, flags);
 	if (!ec)
 		return ec;
 
-	/* fill the data pad with non-zero values */
-	if (jent_notime_settick(ec)) {
+	if (jent_entropy_collector_prime(ec)) {
 		jent_entropy_collector_free(ec);
 		return NULL;
 	}
-	jent_random_data(ec);
-	jent_notime_unsettick(ec);
 
 	return ec;
 }
@@ -522,22 +895,185 @@ struct rand_data *jent_entropy_collector_alloc(unsigned int osr,
 	return ec;
 }
 
+/***************************************************************************
+ * Entropy collector in caller-supplied memory
+ *
+ * The entropy collector state, the hash state, the online estimator and the
+ * memory access buffer are placed one after the other into one region, each
+ * aligned to a cache line. The caller-supplied buffer may be unaligned, the
+ * size reported by jent_entropy_collector_size covers the alignment.
+ *
+ * The size of the memory access buffer depends on the data cache size seen by
+ * the calling thread. Instead of obtaining it a second time, the collector
+ * uses the largest power of 2 fitting into the remainder of the buffer,
+ * limited to the maximum memory size requested with the flags (or
+ * JENT_MEMORY_SIZE) but not to the data cache size. A buffer of the size
+ * reported by jent_entropy_collector_size therefore receives the memory size
+ * that was reported, independent of the thread using it.
+ ***************************************************************************/
+
+#define JENT_INPLACE_ALIGN(x)						\
+	(((x) + JENT_CACHELINE_SIZE - 1) & ~((size_t)JENT_CACHELINE_SIZE - 1))
+
+/* Smallest memory access buffer, i.e. the one of JENT_MAX_MEMSIZE_32kB */
+#define JENT_INPLACE_MIN_MEMSIZE					\
+	(UINT32_C(1) << (1 + JENT_MAX_MEMSIZE_OFFSET))
+
+struct jent_inplace_layout {
+	size_t hash_state;	/* Offset of the hash state */
+	size_t estimator;	/* Offset of the estimator, 0 if unused */
+	size_t mem;		/* Offset of the memory buffer, 0 if unused */
+	uint32_t memsize;	/* Size of the memory buffer */
+	size_t size;		/* Size of the region */
+};
+
+static void jent_inplace_layout(unsigned int flags, uint32_t memsize,
+				struct jent_inplace_layout *layout)
+{
+	size_t size = JENT_INPLACE_ALIGN(sizeof(struct rand_data));
+
+	layout->hash_state = size;
+	size += JENT_INPLACE_ALIGN(SHA_MAX_CTX_SIZE);
+
+	layout->estimator = 0;
+	if (flags & JENT_ONLINE_ESTIMATOR) {
+		layout->estimator = size;
+		size += JENT_INPLACE_ALIGN(jent_estimator_size());
+	}
+
+	layout->mem = 0;
+	layout->memsize = 0;
+	if (!(flags & JENT_DISABLE_MEMORY_ACCESS)) {
+		layout->mem = size;
+		layout->memsize = memsize;
+		size += memsize;
+	}
+
+	layout->size = size;
+}
+
+JENT_PRIVATE_STATIC
+size_t jent_entropy_collector_size(unsigned int flags)
+{
+	struct jent_inplace_layout layout;
+
+	jent_inplace_layout(flags, jent_memsize(flags), &layout);
+
+	/* Allow for aligning an arbitrary buffer */
+	return layout.size + JENT_CACHELINE_SIZE - 1;
+}
+
+/* Release the resources of an entropy collector in caller-supplied memory */
+static void jent_entropy_collector_fini_region(struct rand_data *ec)
+{
+	size_t size = ec->inplace_size;
+
+	jent_notime_disable(ec);
+	jent_memset_secure(ec, size);
+	jent_atomic_add(&jent_collectors, -1);
+}
+
+JENT_PRIVATE_STATIC
+struct rand_data *jent_entropy_collector_init_inplace(void *buf, size_t len,
+						      unsigned int osr,
+						      unsigned int flags)
+{
+	struct jent_inplace_layout layout;
+	struct rand_data *ec;
+	uint8_t *region;
+	size_t avail;
+	uint32_t memsize = 0;
+
+	/* Force the self test to be run */
+	if (jent_entropy_init_once(osr, flags) ||
+	    jent_notime_init_once(osr, flags))
+		return NULL;
+
+	if (!buf || jent_entropy_collector_flags_invalid(flags))
+		return NULL;
+
+	region = (uint8_t *)JENT_INPLACE_ALIGN((uintptr_t)buf);
+	if (len < (size_t)(region - (uint8_t *)buf))
+		return NULL;
+	avail = len - (size_t)(region - (uint8_t *)buf);
+
+	/* Size the memory access buffer from the space left after the state */
+	jent_inplace_layout(flags, 0, &layout);
+	if (avail < layout.size)
+		return NULL;
+	if (layout.mem) {
+		uint32_t max_memsize = jent_max_memsize(flags);
+
+		memsize = max_memsize;
+		while (memsize > avail - layout.size)
+			memsize >>= 1;
+		if (memsize < max_memsize && memsize < JENT_INPLACE_MIN_MEMSIZE)
+			return NULL;
+		jent_inplace_layout(flags, memsize, &layout);
+	}
+
+	memset(region, 0, layout.size);
+	ec = (struct rand_data *)region;
+	ec->inplace_size = layout.size;
+	ec->hash_state = region + layout.hash_state;
+	if (layout.estimator)
+		ec->estimator =
+			(struct jent_estimator *)(region + layout.estimator);
+	if (layout.mem) {
+		ec->mem = region + layout.mem;
+		ec->memsize = layout.memsize;
+	}
+
+	jent_atomic_add(&jent_collectors, 1);
+
+	if (jent_entropy_collector_setup(ec, osr, flags) ||
+	    jent_entropy_collector_prime(ec)) {
+		jent_entropy_collector_fini_region(ec);
+		return NULL;
+	}
+
+	/* Remember that the caller provided a maximum size flag */
+	ec->max_mem_set = !!JENT_FLAGS_TO_MAX_MEMSIZE(flags);
+
+	return ec;
+}
+
+JENT_PRIVATE_STATIC
+void jent_entropy_collector_fini_inplace(struct rand_data *entropy_collector)
+{
+	if (entropy_collector != NULL && entropy_collector->inplace_size)
+		jent_entropy_collector_fini_region(entropy_collector);
+}
+
 JENT_PRIVATE_STATIC
 void jent_entropy_collector_free(struct rand_data *entropy_collector)
 {
 	if (entropy_collector != NULL) {
+		/* The memory of the collector is owned by the caller */
+		if (entropy_collector->inplace_size) {
+			jent_entropy_collector_fini_region(entropy_collector);
+			return;
+		}
+
 		sha3_dealloc(entropy_collector->hash_state);
+		jent_estimator_free(entropy_collector);
 		jent_notime_disable(entropy_collector);
 		if (entropy_collector->mem != NULL) {
 			jent_zfree(entropy_collector->mem,
-				   jent_memsize(entropy_collector->flags));
+				   entropy_collector->memsize);
 			entropy_collector->mem = NULL;
 		}
 		jent_zfree(entropy_collector, sizeof(struct rand_data));
+		jent_atomic_add(&jent_collectors, -1);
 	}
 }
 
-int jent_time_entropy_init(unsigned int osr, unsigned int flags)
+/*
+ * Power-up test of the time stamp source: timer is the external source to be
+ * tested, NULL for the built-in time stamp.
+ */
+static int jent_time_entropy_init_timer(unsigned int osr, unsigned int flags,
+					jent_timer_read_cb timer)
 {
 	struct rand_data *ec;
 	uint64_t *delta_history;
@@ -568,6 +1104,7 @@ int jent_time_entropy_init(unsigned int osr, unsigned int flags)
 		ret = EMEM;
 		goto out;
 	}
+	jent_noise_select_timer(ec, timer);
 
 	if (jent_notime_settick(ec)) {
 		ret = EMEM;
@@ -675,34 +1212,230 @@ out:
 	return ret;
 }
 
+int jent_time_entropy_init(unsigned int osr, unsigned int flags)
+{
+	return jent_time_entropy_init_timer(osr, flags, jent_timer_get());
+}
+
+/***************************************************************************
+ * Time stamp source selection
+ ***************************************************************************/
+
+static struct jent_timer_stat jent_timer_stats[JENT_TIMER_SRC_MAX];
+static int jent_timer_selected = -EAGAIN;
+
+static int jent_u64_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Most Common Value estimate of SP800-90B section 6.3.1 using the upper bound
+ * of the 99% confidence interval, returned in 1/1000 bits. The delta values
+ * are sorted by this function.
+ */
+static uint32_t jent_mcv_min_entropy(uint64_t *delta, unsigned int nelem)
+{
+	unsigned int i, run = 1, max_run = 1;
+
+	qsort(delta, nelem, sizeof(uint64_t), jent_u64_cmp);
+	for (i = 1; i < nelem; i++) {
+		if (delta[i] == delta[i - 1]) {
+			run++;
+			if (run > max_run)
+				max_run = run;
+		} else {
+			run = 1;
+		}
+	}
+
+	return jent_mcv_bound_entropy(max_run, nelem);
+}
+
+/*
+ * Calibrate the currently configured time stamp source: apply the power-on
+ * health tests and measure the min-entropy of the time deltas as well as
+ * the wall time needed to obtain them.
+ */
+static void jent_timer_calibrate(unsigned int osr, unsigned int flags,
+				 jent_timer_read_cb timer,
+				 struct jent_timer_stat *stat)
+{
+	struct rand_data *ec;
+	uint64_t *delta, start, end;
+	unsigned int i, health_test_result;
+
+	stat->ret = jent_time_entropy_init_timer(osr, flags, timer);
+	if (stat->ret)
+		return;
+
+	delta = jent_zalloc(JENT_POWERUP_TESTLOOPCOUNT * sizeof(uint64_t));
+	if (!delta) {
+		stat->ret = EMEM;
+		return;
+	}
+
+	ec = jent_entropy_collector_alloc_internal(osr,
+						  flags | JENT_FORCE_FIPS);
+	if (!ec) {
+		stat->ret = EMEM;
+		goto out;
+	}
+	jent_noise_select_timer(ec, timer);
+
+	if (jent_notime_settick(ec)) {
+		stat->ret = EMEM;
+		goto out;
+	}
+
+	/* To initialize the prior time. */
+	jent_measure_jitter(ec, 0, NULL);
+
+	jent_timer_walltime(&start);
+	for (i = 0; i < JENT_POWERUP_TESTLOOPCOUNT; i++)
+		jent_measure_jitter(ec, 0, &delta[i]);
+	jent_timer_walltime(&end);
+
+	jent_notime_unsettick(ec);
+
+	if ((health_test_result = jent_health_failure(ec))) {
+		stat->ret = (health_test_result & JENT_RCT_FAILURE) ?
+			    ERCT : EHEALTH;
+		goto out;
+	}
+
+	stat->min_entropy = jent_mcv_min_entropy(delta,
+						 JENT_POWERUP_TESTLOOPCOUNT);
+	if (end > start) {
+		stat->sample_ns = (end - start) / JENT_POWERUP_TESTLOOPCOUNT;
+		stat->entropy_rate = (uint64_t)stat->min_entropy *
+				     JENT_POWERUP_TESTLOOPCOUNT * 1000000 /
+				     (end - start);
+	}
+
+out:
+	jent_entropy_collector_free(ec);
+	jent_zfree(delta, JENT_POWERUP_TESTLOOPCOUNT * sizeof(uint64_t));
+}
+
+/*
+ * Calibrate all available time stamp sources and configure the one providing
+ * the highest min-entropy per unit of wall time. If no source passes the
+ * power-on health tests, the configuration is left unchanged.
+ *
+ * The candidates are handed to the calibration collectors directly, the
+ * configured time stamp source is only replaced with the result. This must
+ * only happen while no entropy collector exists.
+ */
+static int jent_timer_select(unsigned int osr, unsigned int flags)
+{
+	jent_timer_read_cb caller_timer = jent_timer_get(), timer;
+	uint64_t best = 0;
+	unsigned int src, src_flags;
+	int forced = jent_notime_forced(), selected = -ENODEV;
+
+	for (src = 0; src < JENT_TIMER_SRC_MAX; src++) {
+		struct jent_timer_stat *stat = &jent_timer_stats[src];
+
+		memset(stat, 0, sizeof(*stat));
+		stat->ret = ENOTIME;
+		src_flags = flags;
+
+		switch (src) {
+		case JENT_TIMER_SRC_HW:
+			timer = NULL;
+			break;
+		case JENT_TIMER_SRC_EXT:
+			if (!caller_timer)
+				continue;
+			timer = caller_timer;
+			break;
+		case JENT_TIMER_SRC_NOTIME:
+#ifdef JENT_CONF_ENABLE_INTERNAL_TIMER
+			if (flags & JENT_DISABLE_INTERNAL_TIMER)
+				continue;
+			timer = NULL;
+			src_flags = flags | JENT_FORCE_INTERNAL_TIMER;
+			break;
+#else /* JENT_CONF_ENABLE_INTERNAL_TIMER */
+			continue;
+#endif /* JENT_CONF_ENABLE_INTERNAL_TIMER */
+		default:
+			timer = jent_timer_clock_cb(src);
+			if (!timer)
+				continue;
+			break;
+		}
+
+		if (!(src_flags & JENT_FORCE_INTERNAL_TIMER))
+			src_flags |= JENT_DISABLE_INTERNAL_TIMER;
+
+		jent_timer_calibrate(osr, src_flags, timer, stat);
+
+		/* The calibration of the internal timer forces its use */
+		if (src == JENT_TIMER_SRC_NOTIME && !forced)
+			jent_notime_unforce();
+
+		if (!stat->ret && stat->entropy_rate > best) {
+			best = stat->entropy_rate;
+			selected = (int)src;
+		}
+	}
+
+	switch (selected) {
+	case JENT_TIMER_SRC_HW:
+	case JENT_TIMER_SRC_NOTIME:
+		jent_timer_set(NULL);
+		break;
+	case JENT_TIMER_SRC_MONOTONIC_RAW:
+	case JENT_TIMER_SRC_MONOTONIC:
+	case JENT_TIMER_SRC_REALTIME:
+		jent_timer_set(jent_timer_clock_cb((unsigned int)selected));
+		break;
+	default:
+		jent_timer_set(caller_timer);
+		break;
+	}
+
+	jent_timer_selected = selected;
+
+	return selected;
+}
+
 static inline int jent_entropy_init_common_pre(void)
 {
 	int ret;
 
+	/* Allocations wait for the self tests executed now */
+	jent_atomic_store(&jent_selftest_passed, 0);
+
 	jent_notime_block_switch();
+	jent_timer_block_switch();
 	jent_health_cb_block_switch();
+	jent_noise_block_register();
 
 	if (sha3_tester())
 		return EHASH;
 
 	ret = jent_gcd_selftest();
+	if (ret)
+		return ret;
 
-	jent_selftest_run = 1;
-
-	return ret;
+	return jent_estimator_selftest();
 }
 
 static inline int jent_entropy_init_common_post(int ret)
 {
-	/* Unmark the execution of the self tests if they failed. */
-	if (ret)
-		jent_selftest_run = 0;
+	/* Mark the successful execution of the self tests. */
+	if (!ret)
+		jent_atomic_store(&jent_selftest_passed, 1);
 
 	return ret;
 }
 
-JENT_PRIVATE_STATIC
-int jent_entropy_init(void)
+static int jent_entropy_init_locked(void)
 {
 	int ret = jent_entropy_init_common_pre();
 
@@ -719,8 +1452,7 @@ int jent_entropy_init(void)
 	return jent_entropy_init_common_post(ret);
 }
 
-JENT_PRIVATE_STATIC
-int jent_entropy_init_ex(unsigned int osr, unsigned int flags)
+static int jent_entropy_init_ex_locked(unsigned int osr, unsigned int flags)
 {
 	int ret = jent_entropy_init_common_pre();
 
@@ -729,6 +1461,19 @@ int jent_entropy_init_ex(unsigned int osr, unsigned int flags)
 
 	ret = ENOTIME;
 
+	/* Select the time stamp source unless caller forces internal timer */
+	if ((flags & JENT_SELECT_TIMER) &&
+	    !(flags & JENT_FORCE_INTERNAL_TIMER)) {
+		/*
+		 * A reinitialization while entropy collectors exist, e.g. by
+		 * jent_read_entropy_safe, keeps the earlier selection.
+		 */
+		if (!jent_atomic_load(&jent_collectors))
+			jent_timer_select(osr, flags);
+		if (jent_timer_selected == JENT_TIMER_SRC_NOTIME)
+			flags |= JENT_FORCE_INTERNAL_TIMER;
+	}
+
 	/* Test without internal timer unless caller does not want it */
 	if (!(flags & JENT_FORCE_INTERNAL_TIMER))
 		ret = jent_time_entropy_init(osr,
@@ -744,14 +1489,119 @@ int jent_entropy_init_ex(unsigned int osr, unsigned int flags)
 	return jent_entropy_init_common_post(ret);
 }
 
+JENT_PRIVATE_STATIC
+int jent_entropy_init(void)
+{
+	int ret;
+
+	jent_init_lock();
+	ret = jent_entropy_init_locked();
+	jent_init_unlock();
+
+	return ret;
+}
+
+JENT_PRIVATE_STATIC
+int jent_entropy_init_ex(unsigned int osr, unsigned int flags)
+{
+	int ret;
+
+	jent_init_lock();
+	ret = jent_entropy_init_ex_locked(osr, flags);
+	jent_init_unlock();
+
+	return ret;
+}
+
 JENT_PRIVATE_STATIC
 int jent_entropy_switch_notime_impl(struct jent_notime_thread *new_thread)
 {
-	return jent_notime_switch(new_thread);
+	int ret;
+
+	jent_init_lock();
+	ret = jent_notime_switch(new_thread);
+	jent_init_unlock();
+
+	return ret;
+}
+
+JENT_PRIVATE_STATIC
+int jent_entropy_switch_timer_impl(jent_timer_read_cb new_timer)
+{
+	int ret;
+
+	jent_init_lock();
+	ret = jent_timer_switch(new_timer);
+	jent_init_unlock();
+
+	return ret;
+}
+
+JENT_PRIVATE_STATIC
+int jent_entropy_register_noise_source(const struct jent_noise_source *src)
+{
+	int ret;
+
+	jent_init_lock();
+	ret = jent_noise_register(src);
+	jent_init_unlock();
+
+	return ret;
+}
+
+JENT_PRIVATE_STATIC
+int jent_entropy_switch_timer_replay(const uint64_t *trace, size_t num)
+{
+#ifdef JENT_CONF_TIMER_REPLAY
+	int ret;
+
+	if (!trace || !num)
+		return -EINVAL;
+
+	jent_init_lock();
+	ret = jent_timer_replay_switch(trace, num);
+	jent_init_unlock();
+
+	return ret;
+#else
+	(void)trace;
+	(void)num;
+	return -EOPNOTSUPP;
+#endif
+}
+
+JENT_PRIVATE_STATIC
+int jent_entropy_estimate(struct rand_data *ec,
+			  struct jent_entropy_estimate *estimate)
+{
+	if (!ec || !estimate)
+		return -EINVAL;
+
+	return jent_estimator_get(ec, estimate);
+}
+
+JENT_PRIVATE_STATIC
+int jent_timer_selection(struct jent_timer_stat stat[JENT_TIMER_SRC_MAX])
+{
+	int ret;
+
+	jent_init_lock();
+	ret = jent_timer_selected;
+	if (ret != -EAGAIN && stat)
+		memcpy(stat, jent_timer_stats, sizeof(jent_timer_stats));
+	jent_init_unlock();
+
+	return ret;
 }
 
 JENT_PRIVATE_STATIC
 int jent_set_fips_failure_callback(jent_fips_failure_cb cb)
 {
-	return jent_set_fips_failure_callback_internal(cb);
+	int ret;
+
+	jent_init_lock();
+	ret = jent_set_fips_failure_callback_internal(cb);
+	jent_init_unlock();
+
+	return ret;
 }
@@ -26,6 +26,8 @@ extern "C"
 #endif
 
 int jent_time_entropy_init(unsigned int osr, unsigned int flags);
+void jent_init_lock(void);
+void jent_init_unlock(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,264 @@
+/* Jitter RNG: Cache topology
+ *
+ * Copyright (C) 2022, Stephan Mueller <smueller@chronox.de>
+ *
+ * License: see LICENSE file in root directory
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "jitterentropy.h"
+
+#include "jitterentropy-cache.h"
+
+#ifdef JENT_CACHE_TOPOLOGY
+
+#include <sys/syscall.h>
+
+/*
+ * Cache topology of the system
+ *
+ * The data and unified caches reachable by every CPU are obtained once per
+ * process from sysfs. CPUs with the same amount of cache are grouped into
+ * one core type (e.g. the performance and efficiency cores of a hybrid CPU
+ * or the CPUs of different sockets with different cache configuration).
+ */
+#define JENT_CACHE_MAX_CPUS	1024
+#define JENT_CACHE_MAX_TYPES	8
+#define JENT_CACHE_MAX_INDEX	8
+
+struct jent_cache_topology {
+	uint32_t type_size[JENT_CACHE_MAX_TYPES];  /* Cache size of core type */
+	uint8_t cpu_type[JENT_CACHE_MAX_CPUS];	    /* Core type of CPU */
+	unsigned int ncpus;			    /* Number of probed CPUs */
+	unsigned int ntypes;			    /* Number of core types */
+};
+
+static struct jent_cache_topology jent_cache_topo;
+static int jent_cache_topo_state = 0;	/* 0 = unset, 1 = probing, 2 = set */
+
+static int jent_sysfs_cache_read(unsigned int cpu, unsigned int idx,
+					const char *attr, char *buf,
+					size_t buflen)
+{
+	char file[80];
+	int fd;
+
+	memset(buf, 0, buflen);
+	snprintf(file, sizeof(file),
+		 "/sys/devices/system/cpu/cpu%u/cache/index%u/%s",
+		 cpu, idx, attr);
+	fd = open(file, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	while (read(fd, buf, buflen - 1) < 0 && errno == EINTR);
+	close(fd);
+
+	return 0;
+}
+
+/* Sum of the data and unified caches of one CPU, 0 if nothing is known */
+static uint32_t jent_get_cpu_cachesize(unsigned int cpu)
+{
+	uint32_t cache_size = 0;
+	unsigned int i;
+	char buf[16];
+
+	/* Iterate over all caches */
+	for (i = 0; i < JENT_CACHE_MAX_INDEX; i++) {
+		unsigned int shift = 0;
+		char *ext;
+		long val;
+
+		/*
+		 * Check the cache type - we are only interested in Unified
+		 * and Data caches.
+		 */
+		if (jent_sysfs_cache_read(cpu, i, "type", buf, sizeof(buf)))
+			break;
+
+		if (strncmp(buf, "Data", 4) && strncmp(buf, "Unified", 7))
+			continue;
+
+		/* Get size of cache */
+		if (jent_sysfs_cache_read(cpu, i, "size", buf, sizeof(buf)))
+			continue;
+
+		ext = strstr(buf, "K");
+		if (ext) {
+			shift = 10;
+			*ext = '\0';
+		} else {
+			ext = strstr(buf, "M");
+			if (ext) {
+				shift = 20;
+				*ext = '\0';
+			}
+		}
+
+		val = strtol(buf, NULL, 10);
+		if (val <= 0 || val == LONG_MAX)
+			continue;
+		cache_size += (uint32_t)val << shift;
+	}
+
+	return cache_size;
+}
+
+static uint32_t jent_cache_roundup(uint32_t cache_size)
+{
+	/*
+	 * Force the output_size to be of the form
+	 * (bounding_power_of_2 - 1).
+	 */
+	cache_size |= (cache_size >> 1);
+	cache_size |= (cache_size >> 2);
+	cache_size |= (cache_size >> 4);
+	cache_size |= (cache_size >> 8);
+	cache_size |= (cache_size >> 16);
+
+	if (cache_size == 0)
+		return 0;
+
+	/*
+	 * Make the output_size the smallest power of 2 strictly
+	 * greater than cache_size.
+	 */
+	return cache_size + 1;
+}
+
+static void jent_cache_topology_probe(struct jent_cache_topology *topo)
+{
+	long ncpu = sysconf(_SC_NPROCESSORS_CONF);
+	unsigned int cpu, type;
+
+	if (ncpu < 1)
+		ncpu = 1;
+	if (ncpu > JENT_CACHE_MAX_CPUS)
+		ncpu = JENT_CACHE_MAX_CPUS;
+
+	for (cpu = 0; cpu < (unsigned int)ncpu; cpu++) {
+		uint32_t cache_size =
+			jent_cache_roundup(jent_get_cpu_cachesize(cpu));
+
+		/* Find the core type with the same cache size */
+		for (type = 0; type < topo->ntypes; type++) {
+			if (topo->type_size[type] == cache_size)
+				break;
+		}
+
+		if (type == topo->ntypes) {
+			/* Account further core types to the last one */
+			if (topo->ntypes < JENT_CACHE_MAX_TYPES)
+				topo->type_size[topo->ntypes++] = cache_size;
+			else
+				type = JENT_CACHE_MAX_TYPES - 1;
+		}
+
+		topo->cpu_type[cpu] = (uint8_t)type;
+	}
+	topo->ncpus = (unsigned int)ncpu;
+
+# if defined(_SC_LEVEL1_DCACHE_SIZE) &&					\
+     defined(_SC_LEVEL2_CACHE_SIZE) &&					\
+     defined(_SC_LEVEL3_CACHE_SIZE)
+	/* No sysfs information available: use the data reported by libc */
+	if (topo->ntypes == 1 && !topo->type_size[0]) {
+		long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+		long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+		long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+		uint32_t cache_size = 0;
+
+		/* Cache size reported by system */
+		if (l1 > 0)
+			cache_size += (uint32_t)l1;
+		if (l2 > 0)
+			cache_size += (uint32_t)l2;
+		if (l3 > 0)
+			cache_size += (uint32_t)l3;
+
+		topo->type_size[0] = jent_cache_roundup(cache_size);
+	}
+# endif
+}
+
+/*
+ * Obtain the cache topology - the probing is performed exactly once per
+ * process, concurrent callers wait until it is completed.
+ */
+static const struct jent_cache_topology *jent_cache_topology(void)
+{
+	int state = 0;
+
+	if (__atomic_load_n(&jent_cache_topo_state, __ATOMIC_ACQUIRE) == 2)
+		return &jent_cache_topo;
+
+	if (__atomic_compare_exchange_n(&jent_cache_topo_state, &state, 1, 0,
+					__ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+		jent_cache_topology_probe(&jent_cache_topo);
+		__atomic_store_n(&jent_cache_topo_state, 2, __ATOMIC_RELEASE);
+		return &jent_cache_topo;
+	}
+
+	while (__atomic_load_n(&jent_cache_topo_state, __ATOMIC_ACQUIRE) != 2)
+		sched_yield();
+
+	return &jent_cache_topo;
+}
+
+/*
+ * Return the cache size rounded up to the next power of 2 that is available
+ * to the calling thread. If the thread may execute on CPUs of different
+ * core types as defined by its CPU affinity, the largest cache size of
+ * those core types is returned.
+ */
+uint32_t jent_cache_size_roundup(void)
+{
+	const struct jent_cache_topology *topo = jent_cache_topology();
+	unsigned long mask[JENT_CACHE_MAX_CPUS / (8 * sizeof(unsigned long))];
+	uint32_t cache_size = 0;
+	unsigned int cpu, type;
+	int have_mask = 0;
+
+#ifdef SYS_sched_getaffinity
+	memset(mask, 0, sizeof(mask));
+	have_mask = (syscall(SYS_sched_getaffinity, 0, sizeof(mask),
+			     mask) > 0);
+#endif
+
+	if (have_mask) {
+		for (cpu = 0; cpu < topo->ncpus; cpu++) {
+			const unsigned int bits = 8 * sizeof(unsigned long);
+
+			if (!(mask[cpu / bits] & (1UL << (cpu % bits))))
+				continue;
+
+			type = topo->cpu_type[cpu];
+			if (topo->type_size[type] > cache_size)
+				cache_size = topo->type_size[type];
+		}
+	}
+
+	/* Affinity unknown: use the largest cache size of all core types */
+	if (!cache_size) {
+		for (type = 0; type < topo->ntypes; type++) {
+			if (topo->type_size[type] > cache_size)
+				cache_size = topo->type_size[type];
+		}
+	}
+
+	return cache_size;
+}
+
+#endif /* JENT_CACHE_TOPOLOGY */
@@ -0,0 +1,379 @@
+/* Jitter RNG: Online SP800-90B min-entropy estimator
+ *
+ * Copyright (C) 2022, Stephan Mueller <smueller@chronox.de>
+ *
+ * License: see LICENSE file in root directory
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "jitterentropy.h"
+
+#include "jitterentropy-estimator.h"
+
+/***************************************************************************
+ * Online min-entropy estimator
+ *
+ * The time deltas seen by the health tests are evaluated in windows of
+ * JENT_ESTIMATOR_WINDOW deltas with streaming versions of the SP800-90B
+ * section 6.3 Most Common Value, Collision and Markov estimates. Only
+ * counters are maintained, the deltas themselves are not stored. All
+ * calculations use fixed-point arithmetic where probabilities carry 32
+ * fractional bits.
+ *
+ * The MCV estimate treats the 8 least significant bits of a delta as one
+ * symbol. The Collision and Markov estimates are defined for binary data
+ * and process the same 8 bits as bit string; their per-bit results are
+ * multiplied by 8 to obtain a value per delta (SP800-90B section 6.1).
+ ***************************************************************************/
+
+#define JENT_ESTIMATOR_SYMBOL_BITS	8
+#define JENT_ESTIMATOR_SYMBOLS		(1U << JENT_ESTIMATOR_SYMBOL_BITS)
+
+/* Markov estimate: length of the sequences evaluated (SP800-90B 6.3.3) */
+#define JENT_ESTIMATOR_MARKOV_LEN	128
+
+#define JENT_Q32_ONE			((uint64_t)1 << 32)
+
+struct jent_estimator {
+	/* Most Common Value */
+	uint32_t mcv_count[JENT_ESTIMATOR_SYMBOLS];
+
+	/* Collision: number of collisions found after 2 and 3 bits */
+	uint32_t coll_t2;
+	uint32_t coll_t3;
+	unsigned int coll_pending;	/* Bits of the open collision search */
+	unsigned int coll_first;	/* First bit of the open search */
+
+	/* Markov: occurrences of bits and of bit transitions */
+	uint32_t markov_bits[2];
+	uint32_t markov_trans[2][2];
+	unsigned int markov_last;	/* Previous bit */
+	unsigned int markov_primed:1;	/* Previous bit available? */
+
+	unsigned int observations;	/* Deltas in the current window */
+
+	struct jent_entropy_estimate result;
+};
+
+/*
+ * Most Common Value estimate of SP800-90B section 6.3.1 using the upper bound
+ * of the 99% confidence interval: count is the number of occurrences of the
+ * most common value out of nelem samples of a symbol of up to 32 bits.
+ *
+ * @return estimate in 1/1000 bits
+ */
+uint32_t jent_mcv_bound_entropy(uint64_t count, uint64_t nelem)
+{
+	uint64_t p, pu, sd;
+
+	p = (count << 32) / nelem;
+	sd = jent_isqrt(p * (JENT_Q32_ONE - p) / (nelem - 1));
+	pu = p + (sd * 2576) / 1000;
+	if (pu > JENT_Q32_ONE)
+		pu = JENT_Q32_ONE;
+
+	return (uint32_t)(((((uint64_t)32 << 16) - jent_log2_q16(pu)) * 1000)
+			  >> 16);
+}
+
+/* -log2(p) in 1/1000 bits for a probability p with 32 fractional bits */
+static inline uint32_t jent_estimator_entropy(uint64_t p)
+{
+	if (!p)
+		return 1000 * 32;
+	if (p > JENT_Q32_ONE)
+		p = JENT_Q32_ONE;
+
+	return (uint32_t)(((((uint64_t)32 << 16) - jent_log2_q16(p)) * 1000)
+			  >> 16);
+}
+
+/*
+ * Collision estimate of SP800-90B section 6.3.2 for binary data. A collision
+ * is found either after 2 bits (the first two bits are equal) or after 3
+ * bits. For a bit with probability p of the more likely value and q = 1 - p
+ * the expected collision time is 2 + 2pq. Solving this for the lower bound
+ * X' of the 99% confidence interval of the mean collision time gives
+ * p = (1 + sqrt(5 - 2X')) / 2.
+ *
+ * @return estimate per bit in 1/1000 bits
+ */
+static uint32_t jent_estimator_collision(struct jent_estimator *est)
+{
+	uint64_t v = (uint64_t)est->coll_t2 + est->coll_t3, x, sd, p;
+
+	if (v < 2)
+		return 0;
+
+	/* X - 2 = t3 / v and the standard deviation of the mean X */
+	x = ((uint64_t)est->coll_t3 << 32) / v;
+	sd = jent_isqrt(((((uint64_t)est->coll_t2 << 32) / v) *
+			 (((uint64_t)est->coll_t3 << 32) / v)) / (v - 1));
+	sd = (sd * 2576) / 1000;
+
+	/* X' - 2 */
+	x = (x > sd) ? x - sd : 0;
+
+	/*
+	 * Every collision found after 2 bits implies a stuck bit - the shift
+	 * below would overflow for it.
+	 */
+	if (!x)
+		p = JENT_Q32_ONE;
+	else if (2 * x >= JENT_Q32_ONE)
+		p = JENT_Q32_ONE / 2;
+	else
+		p = (JENT_Q32_ONE + jent_isqrt((JENT_Q32_ONE - 2 * x) << 32))
+		    / 2;
+
+	return jent_estimator_entropy(p);
+}
+
+/* -log2(count / total) with 16 fractional bits, count must not be zero */
+static inline uint64_t jent_estimator_nlog2_q16(uint64_t count, uint64_t total)
+{
+	return jent_log2_q16(total) - jent_log2_q16(count);
+}
+
+/*
+ * Markov estimate of SP800-90B section 6.3.3 for binary data: the
+ * probability of the most likely sequence of 128 bits out of the candidates
+ * defined by SP800-90B is determined in the logarithmic domain.
+ *
+ * @return estimate per bit in 1/1000 bits
+ */
+static uint32_t jent_estimator_markov(struct jent_estimator *est)
+{
+	/* Number of 00, 01, 10, 11 transitions in the candidate sequences */
+	static const unsigned int trans[6][4] = {
+		{ JENT_ESTIMATOR_MARKOV_LEN - 1, 0, 0, 0 },	/* 000...0 */
+		{ 0, JENT_ESTIMATOR_MARKOV_LEN / 2,
+		  JENT_ESTIMATOR_MARKOV_LEN / 2 - 1, 0 },	/* 0101..1 */
+		{ 0, 1, 0, JENT_ESTIMATOR_MARKOV_LEN - 2 },	/* 011...1 */
+		{ JENT_ESTIMATOR_MARKOV_LEN - 2, 0, 1, 0 },	/* 100...0 */
+		{ 0, JENT_ESTIMATOR_MARKOV_LEN / 2 - 1,
+		  JENT_ESTIMATOR_MARKOV_LEN / 2, 0 },		/* 1010..0 */
+		{ 0, 0, 0, JENT_ESTIMATOR_MARKOV_LEN - 1 },	/* 111...1 */
+	};
+	uint64_t l_init[2], l_trans[2][2], best = UINT64_MAX;
+	uint64_t total = (uint64_t)est->markov_bits[0] + est->markov_bits[1];
+	unsigned int i, a, b, valid[2][2];
+
+	if (!total)
+		return 0;
+
+	for (a = 0; a < 2; a++) {
+		uint64_t out = (uint64_t)est->markov_trans[a][0] +
+			       est->markov_trans[a][1];
+
+		l_init[a] = est->markov_bits[a] ?
+			jent_estimator_nlog2_q16(est->markov_bits[a], total) :
+			UINT64_MAX;
+		for (b = 0; b < 2; b++) {
+			valid[a][b] = !!est->markov_trans[a][b];
+			l_trans[a][b] = valid[a][b] ?
+				jent_estimator_nlog2_q16(
+					est->markov_trans[a][b], out) : 0;
+		}
+	}
+
+	for (i = 0; i < 6; i++) {
+		/* The first three sequences start with 0, the others with 1 */
+		unsigned int init = (i >= 3);
+		uint64_t l = l_init[init];
+
+		/* Sequences with a probability of zero are skipped */
+		for (a = 0; a < 2 && l != UINT64_MAX; a++) {
+			for (b = 0; b < 2; b++) {
+				unsigned int n = trans[i][a * 2 + b];
+
+				if (!n)
+					continue;
+				if (!valid[a][b]) {
+					l = UINT64_MAX;
+					break;
+				}
+				l += n * l_trans[a][b];
+			}
+		}
+
+		if (l < best)
+			best = l;
+	}
+
+	if (best == UINT64_MAX)
+		return 1000;
+
+	best = (best * 1000) / ((uint64_t)JENT_ESTIMATOR_MARKOV_LEN << 16);
+
+	return (best > 1000) ? 1000 : (uint32_t)best;
+}
+
+/* Conclude one window and start the next */
+static void jent_estimator_window(struct jent_estimator *est)
+{
+	struct jent_entropy_estimate *res = &est->result;
+	uint32_t max = 0, min_entropy;
+	unsigned int i;
+
+	for (i = 0; i < JENT_ESTIMATOR_SYMBOLS; i++) {
+		if (est->mcv_count[i] > max)
+			max = est->mcv_count[i];
+	}
+
+	res->mcv = jent_mcv_bound_entropy(max, est->observations);
+	res->collision = jent_estimator_collision(est) *
+			 JENT_ESTIMATOR_SYMBOL_BITS;
+	res->markov = jent_estimator_markov(est) * JENT_ESTIMATOR_SYMBOL_BITS;
+
+	min_entropy = res->mcv;
+	if (res->collision < min_entropy)
+		min_entropy = res->collision;
+	if (res->markov < min_entropy)
+		min_entropy = res->markov;
+	res->min_entropy = min_entropy;
+
+	/* Exponentially weighted average with a weight of 1/8 */
+	if (res->samples == est->observations)
+		res->rolling = min_entropy;
+	else
+		res->rolling = res->rolling - (res->rolling >> 3) +
+			       (min_entropy >> 3);
+
+	/* An entropy of 1/osr bits per delta is required */
+	if (res->rolling) {
+		res->osr = (1000 + res->rolling - 1) / res->rolling;
+		if (res->osr < JENT_MIN_OSR)
+			res->osr = JENT_MIN_OSR;
+	} else {
+		res->osr = 0;
+	}
+
+	memset(est->mcv_count, 0, sizeof(est->mcv_count));
+	est->coll_t2 = 0;
+	est->coll_t3 = 0;
+	est->coll_pending = 0;
+	memset(est->markov_bits, 0, sizeof(est->markov_bits));
+	memset(est->markov_trans, 0, sizeof(est->markov_trans));
+	est->markov_primed = 0;
+	est->observations = 0;
+}
+
+void jent_estimator_insert(struct jent_estimator *est, uint64_t current_delta)
+{
+	unsigned int sym = (unsigned int)(current_delta &
+					  (JENT_ESTIMATOR_SYMBOLS - 1));
+	unsigned int i;
+
+	est->mcv_count[sym]++;
+
+	for (i = 0; i < JENT_ESTIMATOR_SYMBOL_BITS; i++) {
+		unsigned int bit = (sym >> i) & 1;
+
+		/* Collision search */
+		switch (est->coll_pending) {
+		case 0:
+			est->coll_first = bit;
+			est->coll_pending = 1;
+			break;
+		case 1:
+			if (bit == est->coll_first) {
+				est->coll_t2++;
+				est->coll_pending = 0;
+			} else {
+				est->coll_pending = 2;
+			}
+			break;
+		default:
+			est->coll_t3++;
+			est->coll_pending = 0;
+			break;
+		}
+
+		/* Markov chain */
+		est->markov_bits[bit]++;
+		if (est->markov_primed)
+			est->markov_trans[est->markov_last][bit]++;
+		est->markov_last = bit;
+		est->markov_primed = 1;
+	}
+
+	est->result.samples++;
+	if (++est->observations >= JENT_ESTIMATOR_WINDOW)
+		jent_estimator_window(est);
+}
+
+size_t jent_estimator_size(void)
+{
+	return sizeof(struct jent_estimator);
+}
+
+int jent_estimator_alloc(struct rand_data *ec)
+{
+	ec->estimator = jent_zalloc(sizeof(struct jent_estimator));
+	if (!ec->estimator)
+		return 1;
+	return 0;
+}
+
+void jent_estimator_free(struct rand_data *ec)
+{
+	if (!ec->estimator)
+		return;
+
+	jent_zfree(ec->estimator, sizeof(struct jent_estimator));
+	ec->estimator = NULL;
+}
+
+/*
+ * Known-answer test: a constant stream of time deltas must be estimated to
+ * provide no entropy by every estimator.
+ */
+int jent_estimator_selftest(void)
+{
+	struct jent_estimator *est = jent_zalloc(sizeof(struct jent_estimator));
+	unsigned int i;
+	int ret = EESTIMATOR;
+
+	if (!est)
+		return EMEM;
+
+	for (i = 0; i < JENT_ESTIMATOR_WINDOW; i++)
+		jent_estimator_insert(est, 0);
+
+	if (est->result.samples == JENT_ESTIMATOR_WINDOW &&
+	    !est->result.mcv && !est->result.collision &&
+	    !est->result.markov && !est->result.min_entropy)
+		ret = 0;
+
+	jent_zfree(est, sizeof(struct jent_estimator));
+	return ret;
+}
+
+int jent_estimator_get(struct rand_data *ec,
+		       struct jent_entropy_estimate *estimate)
+{
+	struct jent_estimator *est = ec->estimator;
+
+	if (!est)
+		return -EOPNOTSUPP;
+
+	/* No window completed yet */
+	if (est->result.samples < JENT_ESTIMATOR_WINDOW)
+		return -EAGAIN;
+
+	*estimate = est->result;
+	return 0;
+}
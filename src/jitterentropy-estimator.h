@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2022, Stephan Mueller <smueller@chronox.de>
+ *
+ * License: see LICENSE file in root directory
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#ifndef JITTERENTROPY_ESTIMATOR_H
+#define JITTERENTROPY_ESTIMATOR_H
+
+#include "jitterentropy.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Integer square root */
+static inline uint64_t jent_isqrt(uint64_t val)
+{
+	uint64_t res = 0, bit = (uint64_t)1 << 62;
+
+	while (bit > val)
+		bit >>= 2;
+
+	while (bit) {
+		if (val >= res + bit) {
+			val -= res + bit;
+			res = (res >> 1) + bit;
+		} else {
+			res >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return res;
+}
+
+/* log2 of val as fixed-point value with 16 fractional bits */
+static inline uint64_t jent_log2_q16(uint64_t val)
+{
+	uint64_t res, y;
+	unsigned int i, msb = 0;
+
+	for (y = val; y > 1; y >>= 1)
+		msb++;
+	res = (uint64_t)msb << 16;
+
+	/* Normalize val into [1, 2) with 31 fractional bits */
+	y = (msb >= 31) ? val >> (msb - 31) : val << (31 - msb);
+
+	for (i = 0; i < 16; i++) {
+		y = (y * y) >> 31;
+		if (y >= ((uint64_t)1 << 32)) {
+			y >>= 1;
+			res |= (uint64_t)1 << (15 - i);
+		}
+	}
+
+	return res;
+}
+
+uint32_t jent_mcv_bound_entropy(uint64_t count, uint64_t nelem);
+
+size_t jent_estimator_size(void);
+int jent_estimator_alloc(struct rand_data *ec);
+void jent_estimator_free(struct rand_data *ec);
+void jent_estimator_insert(struct jent_estimator *est, uint64_t current_delta);
+int jent_estimator_get(struct rand_data *ec,
+		       struct jent_entropy_estimate *estimate);
+int jent_estimator_selftest(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JITTERENTROPY_ESTIMATOR_H */
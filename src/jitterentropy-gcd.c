@@ -22,12 +22,15 @@
 #include "jitterentropy.h"
 #include "jitterentropy-gcd.h"
 
-/* The common divisor for all timestamp deltas */
-static uint64_t jent_common_timer_gcd = 0;
+/*
+ * The common divisor for all timestamp deltas - written during the
+ * initialization, read by concurrent allocations of entropy collectors.
+ */
+static volatile uint64_t jent_common_timer_gcd = 0;
 
 static inline int jent_gcd_tested(void)
 {
-	return (jent_common_timer_gcd != 0);
+	return (jent_atomic_load64(&jent_common_timer_gcd) != 0);
 }
 
 /* A straight forward implementation of the Euclidean algorithm for GCD. */
@@ -122,7 +125,7 @@ int jent_gcd_analyze(uint64_t *delta_history, size_t nelem)
 
 	/*  Adjust all deltas by the observed (small) common factor. */
 	if (!jent_gcd_tested())
-		jent_common_timer_gcd = running_gcd;
+		jent_atomic_store64(&jent_common_timer_gcd, running_gcd);
 
 out:
 	return ret;
@@ -148,10 +151,12 @@ void jent_gcd_fini(uint64_t *delta_history, size_t nelem)
 
 int jent_gcd_get(uint64_t *value)
 {
-	if (!jent_gcd_tested())
+	uint64_t gcd = jent_atomic_load64(&jent_common_timer_gcd);
+
+	if (!gcd)
 		return 1;
 
-	*value = jent_common_timer_gcd;
+	*value = gcd;
 	return 0;
 }
 
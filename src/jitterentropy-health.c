@@ -20,18 +20,19 @@
  */
 
 #include "jitterentropy-health.h"
+#include "jitterentropy-estimator.h"
 
 static jent_fips_failure_cb fips_cb = NULL;
-static int jent_health_cb_switch_blocked = 0;
+static volatile int jent_health_cb_switch_blocked = 0;
 
 void jent_health_cb_block_switch(void)
 {
-	jent_health_cb_switch_blocked = 1;
+	jent_atomic_store(&jent_health_cb_switch_blocked, 1);
 }
 
 int jent_set_fips_failure_callback_internal(jent_fips_failure_cb cb)
 {
-	if (jent_health_cb_switch_blocked)
+	if (jent_atomic_load(&jent_health_cb_switch_blocked))
 		return -EAGAIN;
 	fips_cb = cb;
 	return 0;
@@ -377,7 +378,9 @@ static void jent_rct_insert(struct rand_data *ec, int stuck)
 		 * Note, we collect (DATA_SIZE_BITS + ENTROPY_SAFETY_FACTOR)*osr
 		 * deltas for inserting them into the entropy pool which should
 		 * then have (close to) DATA_SIZE_BITS bits of entropy in the
-		 * conditioned output.
+		 * conditioned output. With JENT_CONDITIONING_SHA3_512, the
+		 * collection targets the 512 bit digest instead. As H per
+		 * delta is unchanged, so is the cutoff.
 		 *
 		 * Note, ec->rct_count (which equals to value B in the pseudo
 		 * code of SP800-90B section 4.4.1) starts with zero. Hence
@@ -420,6 +423,9 @@ unsigned int jent_stuck(struct rand_data *ec, uint64_t current_delta)
 	jent_apt_insert(ec, current_delta);
 	jent_lag_insert(ec, current_delta);
 
+	if (ec->estimator)
+		jent_estimator_insert(ec->estimator, current_delta);
+
 	if (!current_delta || !delta2 || !delta3) {
 		/* RCT with a stuck bit */
 		jent_rct_insert(ec, 1);
@@ -49,6 +49,17 @@ void jent_apt_init(struct rand_data *ec, unsigned int osr);
 unsigned int jent_stuck(struct rand_data *ec, uint64_t current_delta);
 unsigned int jent_health_failure(struct rand_data *ec);
 
+/* Convert the health test failure mask into the jent_read_entropy error */
+static inline int jent_health_failure_errcode(unsigned int health_test_result)
+{
+	if (health_test_result & JENT_RCT_FAILURE)
+		return -2;
+	else if (health_test_result & JENT_APT_FAILURE)
+		return -3;
+
+	return -5;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -61,7 +61,7 @@ static uint64_t jent_loop_shuffle(struct rand_data *ec,
 	 * Mix the current state of the random number into the shuffle
 	 * calculation to balance that shuffle a bit more.
 	 */
-	jent_get_nstime_internal(ec, &time);
+	ec->noise_ops->get_nstime(ec, &time);
 
 	/*
 	 * We fold the time value as much as possible to ensure that as many
@@ -100,21 +100,43 @@ static uint64_t jent_loop_shuffle(struct rand_data *ec,
 static void jent_hash_time(struct rand_data *ec, uint64_t time,
 			   uint64_t loop_cnt, unsigned int stuck)
 {
-	HASH_CTX_ON_STACK(ctx);
-	uint8_t intermediary[SHA3_256_SIZE_DIGEST];
+	uint64_t state[25];
+	/*
+	 * The message hashed in each loop iteration: the intermediary digest
+	 * followed by the RCT / APT state and the loop counter. The digest
+	 * of one iteration is written back to the start of the message to
+	 * serve as the intermediary value of the next iteration.
+	 */
+	uint8_t msg[SHA3_256_SIZE_DIGEST + sizeof(ec->rct_count) +
+		    sizeof(ec->apt_cutoff) + sizeof(ec->apt_observations) +
+		    sizeof(ec->apt_count) + sizeof(ec->apt_base) +
+		    sizeof(uint64_t)];
+	uint8_t *p = msg + SHA3_256_SIZE_DIGEST;
 	uint64_t j = 0;
 #define MAX_HASH_LOOP 3
 #define MIN_HASH_LOOP 0
 
 	/* Ensure that macros cannot overflow jent_loop_shuffle() */
 	BUILD_BUG_ON((MAX_HASH_LOOP + MIN_HASH_LOOP) > 63);
+	/* The message must be processed with one Keccak operation */
+	BUILD_BUG_ON(sizeof(msg) >= SHA3_256_SIZE_BLOCK);
 	uint64_t hash_loop_cnt =
 		jent_loop_shuffle(ec, MAX_HASH_LOOP, MIN_HASH_LOOP);
 
 	/* Use the memset to shut up valgrind */
-	memset(intermediary, 0, sizeof(intermediary));
-
-	sha3_256_init(&ctx);
+	memset(msg, 0, SHA3_256_SIZE_DIGEST);
+
+	/* The health test state does not change during the loop */
+	memcpy(p, &ec->rct_count, sizeof(ec->rct_count));
+	p += sizeof(ec->rct_count);
+	memcpy(p, &ec->apt_cutoff, sizeof(ec->apt_cutoff));
+	p += sizeof(ec->apt_cutoff);
+	memcpy(p, &ec->apt_observations, sizeof(ec->apt_observations));
+	p += sizeof(ec->apt_observations);
+	memcpy(p, &ec->apt_count, sizeof(ec->apt_count));
+	p += sizeof(ec->apt_count);
+	memcpy(p, &ec->apt_base, sizeof(ec->apt_base));
+	p += sizeof(ec->apt_base);
 
 	/*
 	 * testing purposes -- allow test app to set the counter, not
@@ -134,29 +156,18 @@ static void jent_hash_time(struct rand_data *ec, uint64_t time,
 	 *
 	 * Note, it does not matter which or how much data you inject, we are
 	 * interested in one Keccack1600 compression operation performed with
-	 * the sha3_final.
+	 * the sha3_256_hash_block.
 	 */
 	for (j = 0; j < hash_loop_cnt; j++) {
-		sha3_update(&ctx, intermediary, sizeof(intermediary));
-		sha3_update(&ctx, (uint8_t *)&ec->rct_count,
-			    sizeof(ec->rct_count));
-		sha3_update(&ctx, (uint8_t *)&ec->apt_cutoff,
-			    sizeof(ec->apt_cutoff));
-		sha3_update(&ctx, (uint8_t *)&ec->apt_observations,
-			    sizeof(ec->apt_observations));
-		sha3_update(&ctx, (uint8_t *)&ec->apt_count,
-			    sizeof(ec->apt_count));
-		sha3_update(&ctx,(uint8_t *) &ec->apt_base,
-			    sizeof(ec->apt_base));
-		sha3_update(&ctx, (uint8_t *)&j, sizeof(uint64_t));
-		sha3_final(&ctx, intermediary);
+		memcpy(p, &j, sizeof(uint64_t));
+		sha3_256_hash_block(state, msg, sizeof(msg), msg);
 	}
 
 	/*
 	 * Inject the data from the previous loop into the pool. This data is
 	 * not considered to contain any entropy, but it stirs the pool a bit.
 	 */
-	sha3_update(ec->hash_state, intermediary, sizeof(intermediary));
+	sha3_update(ec->hash_state, msg, SHA3_256_SIZE_DIGEST);
 
 	/*
 	 * Insert the time stamp into the hash context representing the pool.
@@ -170,13 +181,12 @@ static void jent_hash_time(struct rand_data *ec, uint64_t time,
 	if (!stuck)
 		sha3_update(ec->hash_state, (uint8_t *)&time, sizeof(uint64_t));
 
-	jent_memset_secure(&ctx, SHA_MAX_CTX_SIZE);
-	jent_memset_secure(intermediary, sizeof(intermediary));
+	jent_memset_secure(state, sizeof(state));
+	jent_memset_secure(msg, sizeof(msg));
 }
 
 #define MAX_ACC_LOOP_BIT 7
 #define MIN_ACC_LOOP_BIT 0
-#ifdef JENT_RANDOM_MEMACCESS
 
 static inline uint32_t uint32rotl(const uint32_t x, int k)
 {
@@ -200,7 +210,17 @@ static inline uint32_t xoshiro128starstar(uint32_t *s)
 	return result;
 }
 
-static void jent_memaccess(struct rand_data *ec, uint64_t loop_cnt)
+/**
+ * Random memory access noise source -- the memory location to be updated is
+ * selected with a PRNG such that the timing of the updates is mostly
+ * independent of each other
+ *
+ * @ec [in] Reference to the entropy collector with the memory access data --
+ *	    the reference to the memory block to be accessed must not be NULL
+ * @loop_cnt [in] if a value not equal to 0 is set, use the given value as
+ *		  number of loops to perform the memory accesses
+ */
+static void jent_memaccess_random(struct rand_data *ec, uint64_t loop_cnt)
 {
 	uint64_t i = 0, time = 0;
 	union {
@@ -214,8 +234,6 @@ static void jent_memaccess(struct rand_data *ec, uint64_t loop_cnt)
 	uint64_t acc_loop_cnt =
 		jent_loop_shuffle(ec, MAX_ACC_LOOP_BIT, MIN_ACC_LOOP_BIT);
 
-	if (NULL == ec || NULL == ec->mem)
-		return;
 	addressMask = ec->memmask;
 
 	/*
@@ -230,7 +248,7 @@ static void jent_memaccess(struct rand_data *ec, uint64_t loop_cnt)
 	 * timing, so we can now benefit from the Central Limit Theorem!
 	 */
 	for (i = 0; i < sizeof(prngState); i++) {
-		jent_get_nstime_internal(ec, &time);
+		ec->noise_ops->get_nstime(ec, &time);
 		prngState.b[i] ^= (uint8_t)(time & 0xff);
 	}
 
@@ -256,11 +274,9 @@ static void jent_memaccess(struct rand_data *ec, uint64_t loop_cnt)
 	}
 }
 
-#else /* JENT_RANDOM_MEMACCESS */
-
 /**
- * Memory Access noise source -- this is a noise source based on variations in
- * 				 memory access times
+ * Sequential memory access noise source -- this is a noise source based on
+ *					     variations in memory access times
  *
  * This function performs memory accesses which will add to the timing
  * variations due to an unknown amount of CPU wait states that need to be
@@ -276,13 +292,12 @@ static void jent_memaccess(struct rand_data *ec, uint64_t loop_cnt)
  * to reliably access either L3 or memory, the ec->mem memory must be quite
  * large which is usually not desirable.
  *
- * @ec [in] Reference to the entropy collector with the memory access data -- if
- *	    the reference to the memory block to be accessed is NULL, this noise
- *	    source is disabled
+ * @ec [in] Reference to the entropy collector with the memory access data --
+ *	    the reference to the memory block to be accessed must not be NULL
  * @loop_cnt [in] if a value not equal to 0 is set, use the given value as
  *		  number of loops to perform the hash operation
  */
-static void jent_memaccess(struct rand_data *ec, uint64_t loop_cnt)
+static void jent_memaccess_sequential(struct rand_data *ec, uint64_t loop_cnt)
 {
 	unsigned int wrap = 0;
 	uint64_t i = 0;
@@ -292,8 +307,6 @@ static void jent_memaccess(struct rand_data *ec, uint64_t loop_cnt)
 	uint64_t acc_loop_cnt =
 		jent_loop_shuffle(ec, MAX_ACC_LOOP_BIT, MIN_ACC_LOOP_BIT);
 
-	if (NULL == ec || NULL == ec->mem)
-		return;
 	wrap = ec->memblocksize * ec->memblocks;
 
 	/*
@@ -320,7 +333,273 @@ static void jent_memaccess(struct rand_data *ec, uint64_t loop_cnt)
 	}
 }
 
-#endif /* JENT_RANDOM_MEMACCESS */
+/* Number of independent streams of jent_memaccess_multistream */
+#define JENT_MEMACCESS_STREAMS 4
+
+/**
+ * Multi-stream memory access noise source -- EXPERIMENTAL
+ *
+ * Each access of the sequential and random memory access depends on the
+ * previous one, i.e. the CPU waits for one access after the other. This
+ * variant interleaves JENT_MEMACCESS_STREAMS independent streams of random
+ * memory locations, each driven by its own PRNG state, such that the CPU can
+ * keep several accesses in flight. It performs the same number of memory
+ * accesses as jent_memaccess_random.
+ *
+ * @ec [in] Reference to the entropy collector with the memory access data --
+ *	    the reference to the memory block to be accessed must not be NULL
+ * @loop_cnt [in] if a value not equal to 0 is set, use the given value as
+ *		  number of loops to perform the memory accesses
+ */
+static void jent_memaccess_multistream(struct rand_data *ec, uint64_t loop_cnt)
+{
+	uint64_t i = 0, time = 0;
+	union {
+		uint32_t u[JENT_MEMACCESS_STREAMS][4];
+		uint8_t b[JENT_MEMACCESS_STREAMS][sizeof(uint32_t) * 4];
+	} prngState = { .u = {
+		{ 0x8e93eec0, 0xce65608a, 0xa8d46b46, 0xe83cef69 },
+		{ 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 },
+		{ 0xa4093822, 0x299f31d0, 0x082efa98, 0xec4e6c89 },
+		{ 0x452821e6, 0x38d01377, 0xbe5466cf, 0x34e90c6c }
+	} };
+	unsigned char *tmpval[JENT_MEMACCESS_STREAMS];
+	uint64_t total;
+	uint32_t addressMask;
+	unsigned int j, streams;
+
+	/* Ensure that macros cannot overflow jent_loop_shuffle() */
+	BUILD_BUG_ON((MAX_ACC_LOOP_BIT + MIN_ACC_LOOP_BIT) > 63);
+	uint64_t acc_loop_cnt =
+		jent_loop_shuffle(ec, MAX_ACC_LOOP_BIT, MIN_ACC_LOOP_BIT);
+
+	/* The memory size is a power of 2 */
+	addressMask = ec->memsize - 1;
+
+	/*
+	 * Mix the current data into the state of all streams - the streams
+	 * stay independent due to their different initial states.
+	 */
+	for (i = 0; i < sizeof(prngState.b[0]); i++) {
+		ec->noise_ops->get_nstime(ec, &time);
+		for (j = 0; j < JENT_MEMACCESS_STREAMS; j++)
+			prngState.b[j][i] ^= (uint8_t)(time & 0xff);
+	}
+
+	/*
+	 * testing purposes -- allow test app to set the counter, not
+	 * needed during runtime
+	 */
+	if (loop_cnt)
+		acc_loop_cnt = loop_cnt;
+
+	total = ec->memaccessloops + acc_loop_cnt;
+	for (i = 0; i < total; i += streams) {
+		/* The last round only performs the remaining accesses */
+		streams = (total - i < JENT_MEMACCESS_STREAMS) ?
+			  (unsigned int)(total - i) : JENT_MEMACCESS_STREAMS;
+
+		/* Obtain the memory locations of all streams first ... */
+		for (j = 0; j < streams; j++)
+			tmpval[j] = ec->mem +
+				    (xoshiro128starstar(prngState.u[j]) &
+				     addressMask);
+
+		/* ... and update them without dependencies between them. */
+		for (j = 0; j < streams; j++)
+			*tmpval[j] = (unsigned char)((*tmpval[j] + 1) & 0xff);
+	}
+}
+
+/***************************************************************************
+ * Noise source variants
+ *
+ * The timer source (built-in, registered with jent_entropy_switch_timer_impl
+ * or the dedicated or shared internal timer) and the memory access variant
+ * (disabled, sequential, random or multi-stream) are selected once when the
+ * entropy collector is allocated. Each combination is served by its own set
+ * of functions such that the measurement loop does not need to check for
+ * features that are disabled. The external time stamp source is recorded
+ * in the entropy collector for the same reason.
+ ***************************************************************************/
+
+static void jent_get_nstime_hwtimer(struct rand_data *ec, uint64_t *out)
+{
+	(void)ec;
+	jent_get_nstime(out);
+}
+
+static void jent_get_nstime_exttimer(struct rand_data *ec, uint64_t *out)
+{
+	ec->timer_cb(out);
+}
+
+static void jent_memaccess_disabled(struct rand_data *ec, uint64_t loop_cnt)
+{
+	(void)ec;
+	(void)loop_cnt;
+}
+
+/* Memory access variants indexing the tables of noise source variants */
+enum jent_memaccess_variant {
+	JENT_MEMACCESS_VAR_NONE = 0,
+	JENT_MEMACCESS_VAR_SEQUENTIAL,
+	JENT_MEMACCESS_VAR_RANDOM,
+	JENT_MEMACCESS_VAR_MULTISTREAM,
+	JENT_MEMACCESS_VAR_NUM
+};
+
+/* Define the noise source variants of one timer source */
+#define JENT_NOISE_OPS(timer, nstime)					\
+static const struct jent_noise_ops					\
+jent_noise_##timer[JENT_MEMACCESS_VAR_NUM] = {				\
+	[JENT_MEMACCESS_VAR_NONE] = {					\
+		.get_nstime = nstime,					\
+		.memaccess  = jent_memaccess_disabled			\
+	},								\
+	[JENT_MEMACCESS_VAR_SEQUENTIAL] = {				\
+		.get_nstime = nstime,					\
+		.memaccess  = jent_memaccess_sequential			\
+	},								\
+	[JENT_MEMACCESS_VAR_RANDOM] = {					\
+		.get_nstime = nstime,					\
+		.memaccess  = jent_memaccess_random			\
+	},								\
+	[JENT_MEMACCESS_VAR_MULTISTREAM] = {				\
+		.get_nstime = nstime,					\
+		.memaccess  = jent_memaccess_multistream		\
+	}								\
+}
+
+JENT_NOISE_OPS(hwtimer, jent_get_nstime_hwtimer);
+JENT_NOISE_OPS(exttimer, jent_get_nstime_exttimer);
+
+#ifdef JENT_CONF_ENABLE_INTERNAL_TIMER
+JENT_NOISE_OPS(notime, jent_get_nstime_notime);
+JENT_NOISE_OPS(notime_shared, jent_get_nstime_notime_shared);
+#endif /* JENT_CONF_ENABLE_INTERNAL_TIMER */
+
+#ifdef JENT_CONF_TIMER_REPLAY
+JENT_NOISE_OPS(replay, jent_get_nstime_replay);
+#endif /* JENT_CONF_TIMER_REPLAY */
+
+static enum jent_memaccess_variant
+jent_memaccess_variant(const struct rand_data *ec)
+{
+	if (!ec->mem)
+		return JENT_MEMACCESS_VAR_NONE;
+	if (ec->flags & JENT_MEMACCESS_MULTISTREAM)
+		return JENT_MEMACCESS_VAR_MULTISTREAM;
+	if (jent_memaccess_is_sequential(ec->flags))
+		return JENT_MEMACCESS_VAR_SEQUENTIAL;
+	return JENT_MEMACCESS_VAR_RANDOM;
+}
+
+/***************************************************************************
+ * Auxiliary noise sources
+ *
+ * The noise sources registered by the caller are executed after the memory
+ * access and before the time stamp is taken. The list is fixed once
+ * jent_entropy_init is invoked and thus can be read without locking.
+ ***************************************************************************/
+
+static struct jent_noise_source jent_noise_sources[JENT_NOISE_SOURCES_MAX];
+static unsigned int jent_noise_sources_num = 0;
+static volatile int jent_noise_register_blocked = 0;
+
+void jent_noise_block_register(void)
+{
+	jent_atomic_store(&jent_noise_register_blocked, 1);
+}
+
+int jent_noise_register(const struct jent_noise_source *src)
+{
+	/* Ensure that the bounds cannot overflow jent_loop_shuffle() */
+	if (!src || !src->noise || !src->max_loop_bits ||
+	    (src->max_loop_bits + src->min_loop_bits) > 63)
+		return -EINVAL;
+	if (jent_atomic_load(&jent_noise_register_blocked))
+		return -EAGAIN;
+	if (jent_noise_sources_num >= JENT_NOISE_SOURCES_MAX)
+		return -ENOSPC;
+
+	jent_noise_sources[jent_noise_sources_num++] = *src;
+	return 0;
+}
+
+/**
+ * Invoke the auxiliary noise sources
+ *
+ * @ec [in] Reference to entropy collector
+ * @loop_cnt [in] if a value not equal to 0 is set, use the given value as
+ *		  number of loops to perform for each noise source
+ */
+static void jent_noise_aux(struct rand_data *ec, uint64_t loop_cnt)
+{
+	unsigned int i;
+
+	for (i = 0; i < jent_noise_sources_num; i++) {
+		const struct jent_noise_source *src = &jent_noise_sources[i];
+		uint64_t aux_loop_cnt = loop_cnt;
+
+		if (!aux_loop_cnt)
+			aux_loop_cnt = jent_loop_shuffle(ec, src->max_loop_bits,
+							 src->min_loop_bits);
+
+		src->noise(src->ctx, aux_loop_cnt);
+	}
+}
+
+/**
+ * Select the noise source variant matching the configuration of the
+ * entropy collector. This function must be invoked after the timer source
+ * and the memory access buffer of the entropy collector are set up.
+ *
+ * @ec [in] Reference to entropy collector
+ * @timer [in] External time stamp source used by the entropy collector,
+ *	       NULL for the built-in time stamp
+ */
+void jent_noise_select_timer(struct rand_data *ec, jent_timer_read_cb timer)
+{
+	enum jent_memaccess_variant mem = jent_memaccess_variant(ec);
+
+	/* Later changes of the external time stamp source leave ec unaffected */
+	ec->timer_cb = timer;
+
+#ifdef JENT_CONF_TIMER_REPLAY
+	/* A registered trace replaces any time stamp source */
+	if (jent_timer_replay_enabled()) {
+		jent_timer_replay_reset(ec);
+		ec->noise_ops = &jent_noise_replay[mem];
+		return;
+	}
+#endif /* JENT_CONF_TIMER_REPLAY */
+
+#ifdef JENT_CONF_ENABLE_INTERNAL_TIMER
+	if (ec->enable_notime && (ec->flags & JENT_NOTIME_SHARED)) {
+		ec->noise_ops = &jent_noise_notime_shared[mem];
+		return;
+	}
+
+	if (ec->enable_notime) {
+		ec->noise_ops = &jent_noise_notime[mem];
+		return;
+	}
+#endif /* JENT_CONF_ENABLE_INTERNAL_TIMER */
+
+	if (ec->timer_cb) {
+		ec->noise_ops = &jent_noise_exttimer[mem];
+		return;
+	}
+
+	ec->noise_ops = &jent_noise_hwtimer[mem];
+}
+
+/* Select the noise source variant with the configured time stamp source */
+void jent_noise_select(struct rand_data *ec)
+{
+	jent_noise_select_timer(ec, jent_timer_get());
+}
 
 /***************************************************************************
  * Start of entropy processing logic
@@ -350,13 +629,22 @@ unsigned int jent_measure_jitter(struct rand_data *ec,
 	unsigned int stuck;
 
 	/* Invoke one noise source before time measurement to add variations */
-	jent_memaccess(ec, loop_cnt);
+	ec->noise_ops->memaccess(ec, loop_cnt);
+
+	/* Invoke the noise sources registered by the caller */
+	if (jent_noise_sources_num)
+		jent_noise_aux(ec, loop_cnt);
+
+#ifdef JENT_CONF_TIMER_REPLAY
+	/* The measurement consumes the next time delta of the trace */
+	jent_timer_replay_tick(ec);
+#endif /* JENT_CONF_TIMER_REPLAY */
 
 	/*
 	 * Get time stamp and calculate time delta to previous
 	 * invocation to measure the timing variations
 	 */
-	jent_get_nstime_internal(ec, &time);
+	ec->noise_ops->get_nstime(ec, &time);
 	current_delta = jent_delta(ec->prev_time, time) /
 						ec->jent_common_timer_gcd;
 	ec->prev_time = time;
@@ -383,6 +671,7 @@ unsigned int jent_measure_jitter(struct rand_data *ec,
 void jent_random_data(struct rand_data *ec)
 {
 	unsigned int k = 0, safety_factor = 0;
+	unsigned int data_size_bits = jent_data_size_bits(ec);
 
 	if (ec->fips_enabled)
 		safety_factor = ENTROPY_SAFETY_FACTOR;
@@ -399,16 +688,77 @@ void jent_random_data(struct rand_data *ec)
 		 * We multiply the loop value with ->osr to obtain the
 		 * oversampling rate requested by the caller
 		 */
-		if (++k >= ((DATA_SIZE_BITS + safety_factor) * ec->osr))
+		if (++k >= ((data_size_bits + safety_factor) * ec->osr))
+			break;
+	}
+}
+
+/* Number of measurements required to generate one random block */
+static inline unsigned int jent_random_data_bits(struct rand_data *ec)
+{
+	unsigned int safety_factor = 0;
+
+	if (ec->fips_enabled)
+		safety_factor = ENTROPY_SAFETY_FACTOR;
+
+	return (jent_data_size_bits(ec) + safety_factor) * ec->osr;
+}
+
+/**
+ * Incremental variant of jent_random_data
+ *
+ * Perform at most max_measurements measurements of the noise source,
+ * continuing the collection where the previous invocation stopped. The
+ * progress is reset when a random block is generated.
+ *
+ * @ec [in] Reference to entropy collector
+ * @max_measurements [in] Maximum number of measurements to perform
+ *
+ * @return: number of measurements still required for the next random block
+ */
+unsigned int jent_random_data_step(struct rand_data *ec,
+				   unsigned int max_measurements)
+{
+	unsigned int target = jent_random_data_bits(ec), i;
+
+	/* priming of the ->prev_time value */
+	if (!ec->collect_primed) {
+		jent_measure_jitter(ec, 0, NULL);
+		ec->collect_primed = 1;
+	}
+
+	for (i = 0; i < max_measurements && ec->collect_count < target; i++) {
+		if (jent_health_failure(ec))
 			break;
+
+		/* A stuck measurement does not count */
+		if (jent_measure_jitter(ec, 0, NULL))
+			continue;
+
+		ec->collect_count++;
 	}
+
+	return jent_random_data_remaining(ec);
+}
+
+unsigned int jent_random_data_remaining(struct rand_data *ec)
+{
+	unsigned int target = jent_random_data_bits(ec);
+
+	return (ec->collect_count < target) ? target - ec->collect_count : 0;
 }
 
 void jent_read_random_block(struct rand_data *ec, char *dst, size_t dst_len)
 {
-	uint8_t jent_block[SHA3_256_SIZE_DIGEST];
+	uint8_t jent_block[DATA_SIZE_BITS_MAX / 8];
+	size_t blocksize = jent_data_size_bits(ec) / 8;
 
 	BUILD_BUG_ON(SHA3_256_SIZE_DIGEST != (DATA_SIZE_BITS / 8));
+	BUILD_BUG_ON(SHA3_512_SIZE_DIGEST != (DATA_SIZE_BITS_MAX / 8));
+
+	/* Any incremental collection is consumed with this block */
+	ec->collect_count = 0;
+	ec->collect_primed = 0;
 
 	/* The final operation automatically re-initializes the ->hash_state */
 	sha3_final(ec->hash_state, jent_block);
@@ -419,6 +769,6 @@ void jent_read_random_block(struct rand_data *ec, char *dst, size_t dst_len)
 	 * Stir the new state with the data from the old state - the digest
 	 * of the old data is not considered to have entropy.
 	 */
-	sha3_update(ec->hash_state, jent_block, sizeof(jent_block));
+	sha3_update(ec->hash_state, jent_block, blocksize);
 	jent_memset_secure(jent_block, sizeof(jent_block));
 }
@@ -27,10 +27,44 @@ extern "C"
 {
 #endif
 
+/* Noise source variant, see jent_noise_select */
+struct jent_noise_ops {
+	void (*get_nstime)(struct rand_data *ec, uint64_t *out);
+	void (*memaccess)(struct rand_data *ec, uint64_t loop_cnt);
+};
+
+/* Size of one random block generated by the conditioning function in bits */
+static inline unsigned int jent_data_size_bits(const struct rand_data *ec)
+{
+	return (ec->flags & JENT_CONDITIONING_SHA3_512) ?
+		SHA3_512_SIZE_DIGEST_BITS : DATA_SIZE_BITS;
+}
+
+/* Does the entropy collector use the sequential memory access pattern? */
+static inline int jent_memaccess_is_sequential(unsigned int flags)
+{
+	if (flags & (JENT_MEMACCESS_RANDOM | JENT_MEMACCESS_MULTISTREAM))
+		return 0;
+	if (flags & JENT_MEMACCESS_SEQUENTIAL)
+		return 1;
+#ifdef JENT_RANDOM_MEMACCESS
+	return 0;
+#else
+	return 1;
+#endif
+}
+
+void jent_noise_block_register(void);
+int jent_noise_register(const struct jent_noise_source *src);
+void jent_noise_select(struct rand_data *ec);
+void jent_noise_select_timer(struct rand_data *ec, jent_timer_read_cb timer);
 unsigned int jent_measure_jitter(struct rand_data *ec,
 				 uint64_t loop_cnt,
 				 uint64_t *ret_current_delta);
 void jent_random_data(struct rand_data *ec);
+unsigned int jent_random_data_step(struct rand_data *ec,
+				   unsigned int max_measurements);
+unsigned int jent_random_data_remaining(struct rand_data *ec);
 void jent_read_random_block(struct rand_data *ec, char *dst, size_t dst_len);
 
 #ifdef __cplusplus
@@ -268,6 +268,14 @@ void sha3_256_init(struct sha_ctx *ctx)
 	ctx->digestsize = SHA3_256_SIZE_DIGEST;
 }
 
+void sha3_512_init(struct sha_ctx *ctx)
+{
+	sha3_init(ctx);
+	ctx->r = SHA3_512_SIZE_BLOCK;
+	ctx->rword = SHA3_512_SIZE_BLOCK / sizeof(uint64_t);
+	ctx->digestsize = SHA3_512_SIZE_DIGEST;
+}
+
 static inline void sha3_fill_state(struct sha_ctx *ctx, const uint8_t *in)
 {
 	unsigned int i;
@@ -357,6 +365,43 @@ void sha3_final(struct sha_ctx *ctx, uint8_t *digest)
 	sha3_init(ctx);
 }
 
+/*
+ * SHA3-256 of a message that fits into one block.
+ *
+ * The message is absorbed straight into the Keccak lanes provided by the
+ * caller, which avoids the partial block buffer handling of sha3_update and
+ * the (re-)initialization of a full struct sha_ctx. The state is overwritten
+ * with every invocation, the caller is responsible to wipe it after use.
+ *
+ * @state [in/out] Keccak state buffer
+ * @in [in] message, inlen must be smaller than SHA3_256_SIZE_BLOCK
+ * @inlen [in] size of message
+ * @digest [out] buffer of SHA3_256_SIZE_DIGEST bytes receiving the digest
+ */
+void sha3_256_hash_block(uint64_t state[25], const uint8_t *in, size_t inlen,
+			 uint8_t *digest)
+{
+	size_t i, lanes = inlen / 8, tail = inlen % 8;
+
+	for (i = 0; i < 25; i++)
+		state[i] = 0;
+
+	for (i = 0; i < lanes; i++, in += 8)
+		state[i] = ptr_to_le64(in);
+
+	for (i = 0; i < tail; i++)
+		state[lanes] |= (uint64_t)in[i] << (8 * i);
+
+	/* SHA-3 suffix and padding as applied by sha3_final */
+	state[lanes] ^= UINT64_C(0x06) << (8 * tail);
+	state[SHA3_256_SIZE_BLOCK / 8 - 1] ^= UINT64_C(0x80) << 56;
+
+	keccakp_1600(state);
+
+	for (i = 0; i < SHA3_256_SIZE_DIGEST / 8; i++, digest += 8)
+		le64_to_ptr(digest, state[i]);
+}
+
 int sha3_tester(void)
 {
 	HASH_CTX_ON_STACK(ctx);
@@ -367,7 +412,19 @@ int sha3_tester(void)
 					   0x43, 0x86, 0x8C, 0xC4, 0x0E, 0xC5,
 					   0x5E, 0x00, 0xBB, 0xBB, 0xBD, 0xF5,
 					   0x91, 0x1E };
-	uint8_t act[SHA3_256_SIZE_DIGEST] = { 0 };
+	static const uint8_t exp_512[] = { 0x73, 0xDE, 0xE5, 0x10, 0x3A, 0xE5,
+					   0xC1, 0x7E, 0x38, 0xFA, 0x2C, 0xE2,
+					   0xF4, 0x4B, 0x6F, 0x4C, 0xCA, 0x67,
+					   0x99, 0x1B, 0xDC, 0x9E, 0x9A, 0x9E,
+					   0x23, 0x19, 0xF9, 0xC5, 0x9A, 0x23,
+					   0x3A, 0x9A, 0xE8, 0x59, 0xB2, 0x83,
+					   0xE1, 0xF2, 0x03, 0x10, 0xF5, 0x96,
+					   0x04, 0x0A, 0x7D, 0x6A, 0x2C, 0xC9,
+					   0xA5, 0x49, 0xDE, 0x80, 0x09, 0x38,
+					   0x4B, 0xB7, 0x0B, 0x0B, 0xE5, 0xA5,
+					   0x55, 0x66, 0x6A, 0xD7 };
+	uint8_t act[SHA3_512_SIZE_DIGEST] = { 0 };
+	uint64_t state[25];
 	unsigned int i;
 
 	sha3_256_init(&ctx);
@@ -379,6 +436,24 @@ int sha3_tester(void)
 			return 1;
 	}
 
+	memset(act, 0, sizeof(act));
+	sha3_256_hash_block(state, msg_256, 3, act);
+
+	for (i = 0; i < SHA3_256_SIZE_DIGEST; i++) {
+		if (exp_256[i] != act[i])
+			return 1;
+	}
+
+	memset(act, 0, sizeof(act));
+	sha3_512_init(&ctx);
+	sha3_update(&ctx, msg_256, 3);
+	sha3_final(&ctx, act);
+
+	for (i = 0; i < SHA3_512_SIZE_DIGEST; i++) {
+		if (exp_512[i] != act[i])
+			return 1;
+	}
+
 	return 0;
 }
 
@@ -29,6 +29,7 @@ extern "C"
 
 #define SHA3_SIZE_BLOCK(bits)	((1600 - 2 * bits) >> 3)
 #define SHA3_256_SIZE_BLOCK	SHA3_SIZE_BLOCK(SHA3_256_SIZE_DIGEST_BITS)
+#define SHA3_512_SIZE_BLOCK	SHA3_SIZE_BLOCK(SHA3_512_SIZE_DIGEST_BITS)
 #define SHA3_MAX_SIZE_BLOCK	SHA3_256_SIZE_BLOCK
 
 struct sha_ctx {
@@ -45,8 +46,11 @@ struct sha_ctx {
 	struct sha_ctx name
 
 void sha3_256_init(struct sha_ctx *ctx);
+void sha3_512_init(struct sha_ctx *ctx);
 void sha3_update(struct sha_ctx *ctx, const uint8_t *in, size_t inlen);
 void sha3_final(struct sha_ctx *ctx, uint8_t *digest);
+void sha3_256_hash_block(uint64_t state[25], const uint8_t *in, size_t inlen,
+			 uint8_t *digest);
 int sha3_alloc(void **hash_state);
 void sha3_dealloc(void *hash_state);
 int sha3_tester(void);
@@ -21,6 +21,163 @@
 #include "jitterentropy-base.h"
 #include "jitterentropy-timer.h"
 
+/***************************************************************************
+ * External time stamp source
+ ***************************************************************************/
+
+static jent_timer_read_cb jent_timer_ext = NULL;
+static volatile int jent_timer_switch_blocked = 0;
+
+void jent_timer_block_switch(void)
+{
+	jent_atomic_store(&jent_timer_switch_blocked, 1);
+}
+
+int jent_timer_switch(jent_timer_read_cb new_timer)
+{
+	if (jent_atomic_load(&jent_timer_switch_blocked))
+		return -EAGAIN;
+	jent_timer_ext = new_timer;
+	return 0;
+}
+
+jent_timer_read_cb jent_timer_get(void)
+{
+	return jent_timer_ext;
+}
+
+/*
+ * Set the time stamp source irrespective of the switch being blocked - used
+ * by the time stamp source selection during initialization while no entropy
+ * collector exists. Entropy collectors record the source at allocation.
+ */
+void jent_timer_set(jent_timer_read_cb timer)
+{
+	jent_timer_ext = timer;
+}
+
+#ifdef JENT_CONF_TIMER_REPLAY
+
+/***************************************************************************
+ * Replay of a recorded timer trace
+ *
+ * Instead of reading a time stamp, each measurement of a time delta advances
+ * the time stamp of the entropy collector by the next time delta of the
+ * trace. All other time stamp reads return the time stamp of the last
+ * measurement. Every entropy collector replays the trace from its start and
+ * wraps around at its end.
+ ***************************************************************************/
+
+/* Time stamp of a new entropy collector - the power-up test rejects 0 */
+#define JENT_REPLAY_START	(UINT64_C(1) << 32)
+
+static const uint64_t *jent_replay_trace = NULL;
+static size_t jent_replay_num = 0;
+
+int jent_timer_replay_switch(const uint64_t *trace, size_t num)
+{
+	if (jent_atomic_load(&jent_timer_switch_blocked))
+		return -EAGAIN;
+	jent_replay_trace = trace;
+	jent_replay_num = num;
+	return 0;
+}
+
+int jent_timer_replay_enabled(void)
+{
+	return jent_replay_num != 0;
+}
+
+void jent_timer_replay_reset(struct rand_data *ec)
+{
+	ec->replay_time = JENT_REPLAY_START;
+	ec->replay_pos = 0;
+}
+
+void jent_timer_replay_tick(struct rand_data *ec)
+{
+	if (!jent_replay_num)
+		return;
+
+	ec->replay_time += jent_replay_trace[ec->replay_pos];
+	if (++ec->replay_pos >= jent_replay_num)
+		ec->replay_pos = 0;
+}
+
+void jent_get_nstime_replay(struct rand_data *ec, uint64_t *out)
+{
+	*out = ec->replay_time;
+}
+
+#endif /* JENT_CONF_TIMER_REPLAY */
+
+/***************************************************************************
+ * Time stamp source candidates
+ ***************************************************************************/
+
+#ifdef CLOCK_MONOTONIC
+static inline void jent_timer_clock(clockid_t clk, uint64_t *out)
+{
+	struct timespec time;
+
+	if (clock_gettime(clk, &time) == 0) {
+		*out = ((uint64_t)time.tv_sec & 0xFFFFFFFF) * 1000000000UL;
+		*out += (uint64_t)time.tv_nsec;
+	} else {
+		*out = 0;
+	}
+}
+
+#ifdef CLOCK_MONOTONIC_RAW
+static void jent_timer_monotonic_raw(uint64_t *out)
+{
+	jent_timer_clock(CLOCK_MONOTONIC_RAW, out);
+}
+#endif
+
+static void jent_timer_monotonic(uint64_t *out)
+{
+	jent_timer_clock(CLOCK_MONOTONIC, out);
+}
+
+static void jent_timer_realtime(uint64_t *out)
+{
+	jent_timer_clock(CLOCK_REALTIME, out);
+}
+#endif /* CLOCK_MONOTONIC */
+
+jent_timer_read_cb jent_timer_clock_cb(unsigned int src)
+{
+	switch (src) {
+#ifdef CLOCK_MONOTONIC
+#ifdef CLOCK_MONOTONIC_RAW
+	case JENT_TIMER_SRC_MONOTONIC_RAW:
+		return jent_timer_monotonic_raw;
+#endif
+	case JENT_TIMER_SRC_MONOTONIC:
+		return jent_timer_monotonic;
+	case JENT_TIMER_SRC_REALTIME:
+		return jent_timer_realtime;
+#endif /* CLOCK_MONOTONIC */
+	default:
+		return NULL;
+	}
+}
+
+/*
+ * Wall time in nanoseconds used as common reference when comparing the time
+ * stamp sources. If no clock is available, the hardware time stamp is used
+ * which still allows a relative comparison.
+ */
+void jent_timer_walltime(uint64_t *out)
+{
+#ifdef CLOCK_MONOTONIC
+	jent_timer_clock(CLOCK_MONOTONIC, out);
+#else
+	jent_get_nstime(out);
+#endif
+}
+
 #ifdef JENT_CONF_ENABLE_INTERNAL_TIMER
 /***************************************************************************
  * Thread handler
@@ -98,12 +255,13 @@ static struct jent_notime_thread jent_notime_thread_builtin = {
  * that no suitable time source is available.
  ***************************************************************************/
 
-static int jent_force_internal_timer = 0;
-static int jent_notime_switch_blocked = 0;
+/* Written during the initialization, read by concurrent allocations */
+static volatile int jent_force_internal_timer = 0;
+static volatile int jent_notime_switch_blocked = 0;
 
 void jent_notime_block_switch(void)
 {
-	jent_notime_switch_blocked = 1;
+	jent_atomic_store(&jent_notime_switch_blocked, 1);
 }
 
 static struct jent_notime_thread *notime_thread = &jent_notime_thread_builtin;
@@ -131,24 +289,127 @@ static void *jent_notime_sample_timer(void *arg)
 	return NULL;
 }
 
+/*
+ * Shared timer thread: entropy collectors allocated with JENT_NOTIME_SHARED
+ * read the counter of one timer thread per process instead of spawning
+ * their own. Every such entropy collector holds a reference from its
+ * allocation until it is freed: the thread is started with the first
+ * collector and terminated when the last collector is released.
+ */
+struct jent_notime_shared {
+	pthread_mutex_t lock;
+	unsigned int users;
+	void *thread_ctx;
+
+	/* Counter on a cache line of its own, see struct rand_data */
+	uint8_t pad_pre[JENT_CACHELINE_SIZE];
+	volatile uint64_t timer;
+	volatile uint8_t interrupt;
+	uint8_t pad_post[JENT_CACHELINE_SIZE - sizeof(uint64_t) -
+			 sizeof(uint8_t)];
+};
+
+static struct jent_notime_shared jent_notime_shared = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void *jent_notime_sample_timer_shared(void *arg)
+{
+	struct jent_notime_shared *shared = (struct jent_notime_shared *)arg;
+
+	while (1) {
+		if (shared->interrupt)
+			return NULL;
+
+		shared->timer++;
+	}
+
+	return NULL;
+}
+
+static int jent_notime_shared_get(void)
+{
+	struct jent_notime_shared *shared = &jent_notime_shared;
+	int ret = 0;
+
+	pthread_mutex_lock(&shared->lock);
+
+	if (!shared->users) {
+		ret = notime_thread->jent_notime_init(&shared->thread_ctx);
+		if (ret)
+			goto out;
+
+		shared->interrupt = 0;
+		shared->timer = 0;
+
+		ret = notime_thread->jent_notime_start(shared->thread_ctx,
+					jent_notime_sample_timer_shared,
+					shared);
+		if (ret) {
+			notime_thread->jent_notime_fini(shared->thread_ctx);
+			shared->thread_ctx = NULL;
+			goto out;
+		}
+	}
+
+	shared->users++;
+
+out:
+	pthread_mutex_unlock(&shared->lock);
+	return ret;
+}
+
+static void jent_notime_shared_put(void)
+{
+	struct jent_notime_shared *shared = &jent_notime_shared;
+
+	pthread_mutex_lock(&shared->lock);
+
+	if (shared->users && !--shared->users) {
+		shared->interrupt = 1;
+		notime_thread->jent_notime_stop(shared->thread_ctx);
+		notime_thread->jent_notime_fini(shared->thread_ctx);
+		shared->thread_ctx = NULL;
+	}
+
+	pthread_mutex_unlock(&shared->lock);
+}
+
 /*
  * Enable the clock: spawn a new thread that holds a counter.
  *
  * Note, although creating a thread is expensive, we do that every time a
  * caller wants entropy from us and terminate the thread afterwards. This
  * is to ensure an attacker cannot easily identify the ticking thread.
+ * The shared timer thread keeps running while the collector is allocated.
+ * A timer thread that is still running, e.g. across jent_collect_step
+ * invocations, is left untouched.
  */
 int jent_notime_settick(struct rand_data *ec)
 {
+	int ret;
+
 	if (!ec->enable_notime || !notime_thread)
 		return 0;
 
-	ec->notime_interrupt = 0;
+	if (ec->flags & JENT_NOTIME_SHARED) {
+		ec->notime_prev_timer = 0;
+		return 0;
+	}
+
+	if (ec->notime_ticking)
+		return 0;
+
 	ec->notime_prev_timer = 0;
+	ec->notime_interrupt = 0;
 	ec->notime_timer = 0;
 
-	return notime_thread->jent_notime_start(ec->notime_thread_ctx,
-					       jent_notime_sample_timer, ec);
+	ret = notime_thread->jent_notime_start(ec->notime_thread_ctx,
+					      jent_notime_sample_timer, ec);
+	if (!ret)
+		ec->notime_ticking = 1;
+
+	return ret;
 }
 
 void jent_notime_unsettick(struct rand_data *ec)
@@ -156,30 +417,64 @@ void jent_notime_unsettick(struct rand_data *ec)
 	if (!ec->enable_notime || !notime_thread)
 		return;
 
+	if (!ec->notime_ticking)
+		return;
+
 	ec->notime_interrupt = 1;
 	notime_thread->jent_notime_stop(ec->notime_thread_ctx);
+	ec->notime_ticking = 0;
 }
 
-void jent_get_nstime_internal(struct rand_data *ec, uint64_t *out)
+/*
+ * Number of busy-wait iterations before yielding the CPU with
+ * JENT_NOTIME_WAIT_BOUNDED.
+ */
+#define JENT_NOTIME_SPIN_MAX 1024
+
+static inline void jent_notime_read(struct rand_data *ec,
+				    volatile uint64_t *timer, uint64_t *out)
 {
-	if (ec->enable_notime) {
-		/*
-		 * Allow the counting thread to be initialized and guarantee
-		 * that it ticked since last time we looked.
-		 *
-		 * Note, we do not use an atomic operation here for reading
-		 * jent_notime_timer since if this integer is garbled, it even
-		 * adds to entropy. But on most architectures, read/write
-		 * of an uint64_t should be atomic anyway.
-		 */
-		while (ec->notime_timer == ec->notime_prev_timer)
+	unsigned int wait = ec->flags & (JENT_NOTIME_WAIT_SPIN |
+					 JENT_NOTIME_WAIT_BOUNDED);
+	unsigned int spins = 0;
+
+	/*
+	 * Allow the counting thread to be initialized and guarantee
+	 * that it ticked since last time we looked.
+	 *
+	 * Note, we do not use an atomic operation here for reading
+	 * jent_notime_timer since if this integer is garbled, it even
+	 * adds to entropy. But on most architectures, read/write
+	 * of an uint64_t should be atomic anyway.
+	 *
+	 * By default, the CPU is yielded while waiting which is a system call
+	 * per iteration. The caller may select to busy-wait instead, either
+	 * unconditionally or for a limited number of iterations.
+	 */
+	while (*timer == ec->notime_prev_timer) {
+		if (wait == JENT_NOTIME_WAIT_SPIN) {
+			jent_cpu_relax();
+		} else if (wait == JENT_NOTIME_WAIT_BOUNDED &&
+			   spins < JENT_NOTIME_SPIN_MAX) {
+			jent_cpu_relax();
+			spins++;
+		} else {
 			jent_yield();
-
-		ec->notime_prev_timer = ec->notime_timer;
-		*out = ec->notime_prev_timer;
-	} else {
-		jent_get_nstime(out);
+		}
 	}
+
+	ec->notime_prev_timer = *timer;
+	*out = ec->notime_prev_timer;
+}
+
+void jent_get_nstime_notime(struct rand_data *ec, uint64_t *out)
+{
+	jent_notime_read(ec, &ec->notime_timer, out);
+}
+
+void jent_get_nstime_notime_shared(struct rand_data *ec, uint64_t *out)
+{
+	jent_notime_read(ec, &jent_notime_shared.timer, out);
 }
 
 static inline int jent_notime_enable_thread(struct rand_data *ec)
@@ -191,21 +486,51 @@ static inline int jent_notime_enable_thread(struct rand_data *ec)
 
 void jent_notime_disable(struct rand_data *ec)
 {
-	if (notime_thread)
-		notime_thread->jent_notime_fini(ec->notime_thread_ctx);
+	if (!notime_thread)
+		return;
+
+	/* Stop a timer thread left running by jent_collect_step */
+	jent_notime_unsettick(ec);
+
+	/* Drop the reference to the shared timer thread */
+	if (ec->flags & JENT_NOTIME_SHARED) {
+		if (ec->enable_notime)
+			jent_notime_shared_put();
+		return;
+	}
+
+	notime_thread->jent_notime_fini(ec->notime_thread_ctx);
 }
 
+/*
+ * Enable the internal timer for the entropy collector.
+ *
+ * This function does not take the init lock as it is invoked both with and
+ * without it being held. The power-up test of the internal timer must have
+ * passed before, i.e. jent_notime_forced() must return true if
+ * JENT_FORCE_INTERNAL_TIMER is requested.
+ */
 int jent_notime_enable(struct rand_data *ec, unsigned int flags)
 {
+	int forced = jent_notime_forced();
+
 	/* Use internal timer */
-	if (jent_force_internal_timer || (flags & JENT_FORCE_INTERNAL_TIMER)) {
+	if (forced || (flags & JENT_FORCE_INTERNAL_TIMER)) {
 		/* Self test not run yet */
-		if (!jent_force_internal_timer &&
-		    jent_time_entropy_init(ec->osr,
-					   flags | JENT_FORCE_INTERNAL_TIMER))
+		if (!forced)
 			return EHEALTH;
 
+		/* Take a reference to the shared timer thread */
+		if (flags & JENT_NOTIME_SHARED) {
+			int ret = jent_notime_shared_get();
+
+			if (!ret)
+				ec->enable_notime = 1;
+			return ret;
+		}
+
 		ec->enable_notime = 1;
+
 		return jent_notime_enable_thread(ec);
 	}
 
@@ -214,7 +539,7 @@ int jent_notime_enable(struct rand_data *ec, unsigned int flags)
 
 int jent_notime_switch(struct jent_notime_thread *new_thread)
 {
-	if (jent_notime_switch_blocked)
+	if (jent_atomic_load(&jent_notime_switch_blocked))
 		return -EAGAIN;
 	notime_thread = new_thread;
 	return 0;
@@ -222,12 +547,17 @@ int jent_notime_switch(struct jent_notime_thread *new_thread)
 
 void jent_notime_force(void)
 {
-	jent_force_internal_timer = 1;
+	jent_atomic_store(&jent_force_internal_timer, 1);
+}
+
+void jent_notime_unforce(void)
+{
+	jent_atomic_store(&jent_force_internal_timer, 0);
 }
 
 int jent_notime_forced(void)
 {
-	return jent_force_internal_timer;
+	return jent_atomic_load(&jent_force_internal_timer);
 }
 
 #endif /* JENT_CONF_ENABLE_INTERNAL_TIMER */
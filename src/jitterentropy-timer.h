@@ -27,16 +27,33 @@ extern "C"
 {
 #endif
 
+void jent_timer_block_switch(void);
+int jent_timer_switch(jent_timer_read_cb new_timer);
+jent_timer_read_cb jent_timer_get(void);
+void jent_timer_set(jent_timer_read_cb timer);
+jent_timer_read_cb jent_timer_clock_cb(unsigned int src);
+void jent_timer_walltime(uint64_t *out);
+
+#ifdef JENT_CONF_TIMER_REPLAY
+int jent_timer_replay_switch(const uint64_t *trace, size_t num);
+int jent_timer_replay_enabled(void);
+void jent_timer_replay_reset(struct rand_data *ec);
+void jent_timer_replay_tick(struct rand_data *ec);
+void jent_get_nstime_replay(struct rand_data *ec, uint64_t *out);
+#endif /* JENT_CONF_TIMER_REPLAY */
+
 #ifdef JENT_CONF_ENABLE_INTERNAL_TIMER
 
 void jent_notime_block_switch(void);
 int jent_notime_settick(struct rand_data *ec);
 void jent_notime_unsettick(struct rand_data *ec);
-void jent_get_nstime_internal(struct rand_data *ec, uint64_t *out);
+void jent_get_nstime_notime(struct rand_data *ec, uint64_t *out);
+void jent_get_nstime_notime_shared(struct rand_data *ec, uint64_t *out);
 int jent_notime_enable(struct rand_data *ec, unsigned int flags);
 void jent_notime_disable(struct rand_data *ec);
 int jent_notime_switch(struct jent_notime_thread *new_thread);
 void jent_notime_force(void);
+void jent_notime_unforce(void);
 int jent_notime_forced(void);
 
 #else /* JENT_CONF_ENABLE_INTERNAL_TIMER */
@@ -51,12 +68,6 @@ static inline int jent_notime_settick(struct rand_data *ec)
 
 static inline void jent_notime_unsettick(struct rand_data *ec) { (void)ec; }
 
-static inline void jent_get_nstime_internal(struct rand_data *ec, uint64_t *out)
-{
-	(void)ec;
-	jent_get_nstime(out);
-}
-
 static inline int jent_notime_enable(struct rand_data *ec, unsigned int flags)
 {
 	(void)ec;
@@ -81,6 +92,8 @@ static inline int jent_notime_switch(struct jent_notime_thread *new_thread)
 
 static inline void jent_notime_force(void) { }
 
+static inline void jent_notime_unforce(void) { }
+
 static inline int jent_notime_forced(void) { return 0; }
 
 #endif /* JENT_CONF_ENABLE_INTERNAL_TIMER */
@@ -0,0 +1,138 @@
+/* Jitter RNG: Thread-local entropy collector
+ *
+ * Copyright (C) 2022, Stephan Mueller <smueller@chronox.de>
+ *
+ * License: see LICENSE file in root directory
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "jitterentropy.h"
+
+#ifdef JENT_CONF_ENABLE_THREADS
+
+/***************************************************************************
+ * Thread-local entropy collector
+ *
+ * Every thread invoking jent_read_entropy_tls obtains its own entropy
+ * collector which is allocated with the first request and released by the
+ * destructor of a pthread key when the thread terminates. This avoids both
+ * allocating a collector per request and serializing all threads on one
+ * shared collector.
+ ***************************************************************************/
+
+static pthread_once_t jent_tls_once = PTHREAD_ONCE_INIT;
+static pthread_key_t jent_tls_key;
+static int jent_tls_key_ret = 0;
+
+/* Configuration of the collectors allocated in the future */
+static pthread_mutex_t jent_tls_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int jent_tls_osr = 0;
+static unsigned int jent_tls_flags = 0;
+
+static void jent_tls_destructor(void *ec)
+{
+	jent_entropy_collector_free((struct rand_data *)ec);
+}
+
+static void jent_tls_key_init(void)
+{
+	jent_tls_key_ret = pthread_key_create(&jent_tls_key,
+					      jent_tls_destructor);
+}
+
+JENT_PRIVATE_STATIC
+int jent_entropy_tls_config(unsigned int osr, unsigned int flags)
+{
+	pthread_mutex_lock(&jent_tls_lock);
+	jent_tls_osr = osr;
+	jent_tls_flags = flags;
+	pthread_mutex_unlock(&jent_tls_lock);
+
+	return 0;
+}
+
+JENT_PRIVATE_STATIC
+ssize_t jent_read_entropy_tls(char *data, size_t len)
+{
+	struct rand_data *ec;
+	unsigned int osr, flags;
+	ssize_t ret;
+
+	if (pthread_once(&jent_tls_once, jent_tls_key_init) ||
+	    jent_tls_key_ret)
+		return -1;
+
+	ec = pthread_getspecific(jent_tls_key);
+	if (!ec) {
+		pthread_mutex_lock(&jent_tls_lock);
+		osr = jent_tls_osr;
+		flags = jent_tls_flags;
+		pthread_mutex_unlock(&jent_tls_lock);
+
+		ec = jent_entropy_collector_alloc(osr, flags);
+		if (!ec)
+			return -1;
+	}
+
+	/* A health failure may reallocate or release the collector */
+	ret = jent_read_entropy_safe(&ec, data, len);
+
+	if (pthread_setspecific(jent_tls_key, ec)) {
+		jent_entropy_collector_free(ec);
+		return -1;
+	}
+
+	return ret;
+}
+
+JENT_PRIVATE_STATIC
+void jent_entropy_tls_free(void)
+{
+	struct rand_data *ec;
+
+	if (pthread_once(&jent_tls_once, jent_tls_key_init) ||
+	    jent_tls_key_ret)
+		return;
+
+	ec = pthread_getspecific(jent_tls_key);
+	if (!ec)
+		return;
+
+	pthread_setspecific(jent_tls_key, NULL);
+	jent_entropy_collector_free(ec);
+}
+
+#else /* JENT_CONF_ENABLE_THREADS */
+
+JENT_PRIVATE_STATIC
+int jent_entropy_tls_config(unsigned int osr, unsigned int flags)
+{
+	(void)osr;
+	(void)flags;
+	return -EOPNOTSUPP;
+}
+
+JENT_PRIVATE_STATIC
+ssize_t jent_read_entropy_tls(char *data, size_t len)
+{
+	(void)data;
+	(void)len;
+	return -EOPNOTSUPP;
+}
+
+JENT_PRIVATE_STATIC
+void jent_entropy_tls_free(void) { }
+
+#endif /* JENT_CONF_ENABLE_THREADS */
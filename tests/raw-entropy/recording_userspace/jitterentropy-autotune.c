@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2022, Stephan Mueller <smueller@chronox.de>
+ *
+ * License: see LICENSE file in root directory
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Search the cheapest configuration of the Jitter RNG on the current system
+ *
+ * jent_autotune is invoked for all memory access settings and the result
+ * is printed. The recommended oversampling rate and flags can be written
+ * to a file to be used by the consumer of the Jitter RNG.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "jitterentropy.h"
+
+static void autotune_usage(const char *name)
+{
+	printf("%s [--margin <PERCENT>] [--force-fips] [--disable-internal-timer|--force-internal-timer] [--max-mem <NUM>] [--output <FILE>]\n",
+	       name);
+}
+
+static int autotune_write(const char *file, struct jent_autotune_stat *stat)
+{
+	FILE *f = fopen(file, "w");
+
+	if (!f) {
+		printf("Cannot open %s\n", file);
+		return 1;
+	}
+
+	fprintf(f, "# Jitter RNG configuration recommended by jitterentropy-autotune\n");
+	fprintf(f, "JENT_OSR=%u\n", stat->osr);
+	fprintf(f, "JENT_FLAGS=0x%x\n", stat->flags);
+
+	if (fclose(f)) {
+		printf("Cannot write %s\n", file);
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct jent_autotune_stat stat[JENT_AUTOTUNE_MAX];
+	const char *output = NULL;
+	unsigned long val;
+	unsigned int flags = 0, margin = 50, i;
+	int best;
+
+	while (argc > 1) {
+		if (!strcmp(argv[1], "--force-fips")) {
+			flags |= JENT_FORCE_FIPS;
+		} else if (!strcmp(argv[1], "--disable-internal-timer")) {
+			flags |= JENT_DISABLE_INTERNAL_TIMER;
+		} else if (!strcmp(argv[1], "--force-internal-timer")) {
+			flags |= JENT_FORCE_INTERNAL_TIMER;
+		} else if (!strcmp(argv[1], "--margin") && argc > 2) {
+			argc--;
+			argv++;
+			val = strtoul(argv[1], NULL, 10);
+			if (val > 10000)
+				return 1;
+			margin = (unsigned int)val;
+		} else if (!strcmp(argv[1], "--max-mem") && argc > 2) {
+			argc--;
+			argv++;
+			val = strtoul(argv[1], NULL, 10);
+			if (!val || val >= JENT_AUTOTUNE_MAX)
+				return 1;
+			flags |= JENT_MAX_MEMSIZE_TO_FLAGS((unsigned int)val);
+		} else if (!strcmp(argv[1], "--output") && argc > 2) {
+			argc--;
+			argv++;
+			output = argv[1];
+		} else {
+			autotune_usage(argv[0]);
+			return 1;
+		}
+		argc--;
+		argv++;
+	}
+
+	best = jent_autotune(flags, margin, stat);
+
+	printf("%-10s %10s %8s %6s %10s %12s\n", "memsize", "flags", "H_min",
+	       "osr", "ns/sample", "ns/block");
+
+	for (i = 0; i < JENT_AUTOTUNE_MAX; i++) {
+		if (stat[i].ret == ENOTIME)
+			continue;
+
+		if (stat[i].ret) {
+			printf("%-10" PRIu32 " %#10x error %d\n", stat[i].memsize,
+			       stat[i].flags, stat[i].ret);
+			continue;
+		}
+
+		printf("%-10" PRIu32 " %#10x %8.3f %6u %10" PRIu64 " %12" PRIu64 "%s\n",
+		       stat[i].memsize, stat[i].flags,
+		       (double)stat[i].min_entropy / 1000, stat[i].osr,
+		       stat[i].sample_ns, stat[i].block_ns,
+		       (int)i == best ? " *" : "");
+	}
+
+	if (best < 0) {
+		printf("No usable configuration found\n");
+		return 1;
+	}
+
+	/* The oversampling rate is only raised above the default if needed */
+	printf("Recommended: osr %u (default %u), flags 0x%x (margin %u%%)\n",
+	       stat[best].osr, JENT_MIN_OSR, stat[best].flags, margin);
+
+	if (output)
+		return autotune_write(output, &stat[best]);
+
+	return 0;
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2022, Stephan Mueller <smueller@chronox.de>
+ *
+ * License: see LICENSE file in root directory
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Example auxiliary noise sources for the recording tools
+ *
+ * The noise sources are registered with jent_entropy_register_noise_source
+ * to analyze whether they add variations to the measured time deltas:
+ *
+ *	branch:		data-dependent branches that cannot be predicted
+ *	indirect:	indirect calls through a table of functions
+ *	tlb:		accesses to pseudo-random pages of a buffer larger
+ *			than the TLB reach
+ *
+ * The contexts are not protected against concurrent use and are therefore
+ * only suitable for tools using one entropy collector at a time.
+ */
+
+#ifndef JITTERENTROPY_AUXNOISE_H
+#define JITTERENTROPY_AUXNOISE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jitterentropy.h"
+
+#define JENT_AUXNOISE_USAGE "[--aux branch|indirect|tlb]"
+
+struct jent_auxnoise_ctx {
+	uint64_t state;		/* xorshift state selecting the operation */
+	volatile uint64_t sink;	/* Result keeping the operation alive */
+	unsigned char *buf;	/* Buffer of the TLB walk */
+};
+
+/* Number of 4 kB pages of the TLB walk - 64 MB exceed common TLB reaches */
+#define JENT_AUXNOISE_TLB_PAGES		16384
+#define JENT_AUXNOISE_PAGE_SIZE		4096
+
+static inline uint64_t jent_auxnoise_next(struct jent_auxnoise_ctx *ctx)
+{
+	uint64_t x = ctx->state;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	ctx->state = x;
+
+	return x;
+}
+
+static void jent_auxnoise_branch(void *ctx, uint64_t loop_cnt)
+{
+	struct jent_auxnoise_ctx *aux = ctx;
+	uint64_t i, sink = aux->sink;
+
+	for (i = 0; i < loop_cnt; i++) {
+		uint64_t x = jent_auxnoise_next(aux);
+
+		if (x & 1)
+			sink += x;
+		else
+			sink ^= x >> 3;
+
+		if (x & 2)
+			sink = (sink << 1) | (sink >> 63);
+	}
+
+	aux->sink = sink;
+}
+
+static uint64_t jent_auxnoise_fn0(uint64_t v) { return v + 0x9e3779b97f4a7c15ULL; }
+static uint64_t jent_auxnoise_fn1(uint64_t v) { return v ^ (v >> 31); }
+static uint64_t jent_auxnoise_fn2(uint64_t v) { return v * 0xbf58476d1ce4e5b9ULL; }
+static uint64_t jent_auxnoise_fn3(uint64_t v) { return (v << 7) | (v >> 57); }
+static uint64_t jent_auxnoise_fn4(uint64_t v) { return ~v; }
+static uint64_t jent_auxnoise_fn5(uint64_t v) { return v - (v >> 17); }
+static uint64_t jent_auxnoise_fn6(uint64_t v) { return v * 0x94d049bb133111ebULL; }
+static uint64_t jent_auxnoise_fn7(uint64_t v) { return v ^ (v << 23); }
+
+static void jent_auxnoise_indirect(void *ctx, uint64_t loop_cnt)
+{
+	static uint64_t (* const fn[8])(uint64_t) = {
+		jent_auxnoise_fn0, jent_auxnoise_fn1, jent_auxnoise_fn2,
+		jent_auxnoise_fn3, jent_auxnoise_fn4, jent_auxnoise_fn5,
+		jent_auxnoise_fn6, jent_auxnoise_fn7
+	};
+	struct jent_auxnoise_ctx *aux = ctx;
+	uint64_t i, sink = aux->sink;
+
+	for (i = 0; i < loop_cnt; i++)
+		sink = fn[jent_auxnoise_next(aux) & 7](sink);
+
+	aux->sink = sink;
+}
+
+static void jent_auxnoise_tlb(void *ctx, uint64_t loop_cnt)
+{
+	struct jent_auxnoise_ctx *aux = ctx;
+	uint64_t i;
+
+	for (i = 0; i < loop_cnt; i++) {
+		uint64_t x = jent_auxnoise_next(aux);
+		unsigned char *p = aux->buf +
+			(x % JENT_AUXNOISE_TLB_PAGES) * JENT_AUXNOISE_PAGE_SIZE +
+			((x >> 32) % JENT_AUXNOISE_PAGE_SIZE);
+
+		*p = (unsigned char)(*p + 1);
+	}
+}
+
+static struct jent_auxnoise_ctx jent_auxnoise_ctx[3] = {
+	{ 0x853c49e6748fea9bULL, 0, NULL },
+	{ 0xda3e39cb94b95bdbULL, 0, NULL },
+	{ 0x2545f4914f6cdd1dULL, 0, NULL },
+};
+
+static const struct jent_noise_source jent_auxnoise_sources[] = {
+	{ "branch", jent_auxnoise_branch, &jent_auxnoise_ctx[0], 4, 4 },
+	{ "indirect", jent_auxnoise_indirect, &jent_auxnoise_ctx[1], 4, 4 },
+	{ "tlb", jent_auxnoise_tlb, &jent_auxnoise_ctx[2], 2, 3 },
+};
+
+#define JENT_AUXNOISE_NUM \
+	(sizeof(jent_auxnoise_sources) / sizeof(jent_auxnoise_sources[0]))
+
+/* Names of the registered noise sources for the metadata */
+static char jent_auxnoise_registered[64];
+
+/* Register the example noise source with the given name */
+static inline int jent_auxnoise_register(const char *name)
+{
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < JENT_AUXNOISE_NUM; i++) {
+		const struct jent_noise_source *src = &jent_auxnoise_sources[i];
+
+		if (strcmp(name, src->name))
+			continue;
+
+		if (src->noise == jent_auxnoise_tlb && !jent_auxnoise_ctx[i].buf) {
+			jent_auxnoise_ctx[i].buf = calloc(JENT_AUXNOISE_TLB_PAGES,
+							  JENT_AUXNOISE_PAGE_SIZE);
+			if (!jent_auxnoise_ctx[i].buf) {
+				printf("Allocation of the TLB walk buffer failed\n");
+				return 1;
+			}
+		}
+
+		ret = jent_entropy_register_noise_source(src);
+		if (ret) {
+			printf("Registering noise source %s failed with error code %d\n",
+			       name, ret);
+			return 1;
+		}
+
+		if (jent_auxnoise_registered[0])
+			strncat(jent_auxnoise_registered, ",",
+				sizeof(jent_auxnoise_registered) -
+				strlen(jent_auxnoise_registered) - 1);
+		strncat(jent_auxnoise_registered, name,
+			sizeof(jent_auxnoise_registered) -
+			strlen(jent_auxnoise_registered) - 1);
+		return 0;
+	}
+
+	printf("Unknown noise source %s\n", name);
+	return 1;
+}
+
+/*
+ * Parse the option at argv[*arg] - returns 1 if the option is consumed,
+ * 0 if it is no noise source option and -1 on an error.
+ */
+static inline int jent_auxnoise_option(int argc, char *argv[], int *arg)
+{
+	if (strcmp(argv[*arg], "--aux"))
+		return 0;
+
+	if (*arg + 1 >= argc) {
+		printf("Noise source name missing\n");
+		return -1;
+	}
+
+	return jent_auxnoise_register(argv[++(*arg)]) ? -1 : 1;
+}
+
+/* Write the registered noise sources as comment line */
+static inline void jent_auxnoise_metadata(FILE *out)
+{
+	fprintf(out, "# aux=%s\n",
+		jent_auxnoise_registered[0] ? jent_auxnoise_registered : "none");
+}
+
+#endif /* JITTERENTROPY_AUXNOISE_H */
@@ -17,6 +17,8 @@
  * DAMAGE.
  */
 
+#include "jitterentropy-recording.h"
+
 #include <inttypes.h>
 #include <stdlib.h>
 #include <limits.h>
@@ -26,12 +28,16 @@
 #include <string.h>
 
 #include "jitterentropy-sha3.c"
+#include "jitterentropy-cache.c"
 #include "jitterentropy-gcd.c"
+#include "jitterentropy-estimator.c"
 #include "jitterentropy-health.c"
 #include "jitterentropy-noise.c"
 #include "jitterentropy-timer.c"
 #include "jitterentropy-base.c"
 
+#include "jitterentropy-auxnoise.h"
+
 #ifndef REPORT_COUNTER_TICKS
 #define REPORT_COUNTER_TICKS 1
 #endif
@@ -39,8 +45,32 @@
 /***************************************************************************
  * Statistical test logic not compiled for regular operation
  ***************************************************************************/
+
+/*
+ * Record the configuration of the run as comment lines at the beginning of
+ * the output file. The validation tools skip lines starting with '#'.
+ */
+static void jent_write_header(FILE *out, struct rand_data *ec,
+			      unsigned long rounds, unsigned int flags,
+			      const struct jent_recording *rec)
+{
+	uint64_t memsize = ec->mem ? ec->memsize : 0;
+
+	fprintf(out, "# jitterentropy-hashtime %u.%u.%u\n",
+		(jent_version() / 1000000),
+		(jent_version() / 10000) % 100,
+		(jent_version() / 100) % 100);
+	fprintf(out, "# rounds=%lu osr=%u flags=0x%x memsize=%" PRIu64 " timer=%s\n",
+		rounds, ec->osr, flags, memsize,
+		ec->enable_notime ? "internal" : "hardware");
+	jent_auxnoise_metadata(out);
+	jent_recording_metadata(out, rec);
+}
+
 static int jent_one_test(const char *pathname, unsigned long rounds,
-			 unsigned int flags, int report_counter_ticks)
+			 unsigned int osr, unsigned int flags,
+			 int report_counter_ticks,
+			 const struct jent_recording *rec)
 {
 	unsigned long size = 0;
 	struct rand_data *ec = NULL, *ec_min = NULL;
@@ -67,18 +97,18 @@ static int jent_one_test(const char *pathname, unsigned long rounds,
 		goto out;
 	}
 
-	ret = jent_entropy_init();
+	ret = jent_entropy_init_ex(osr, flags);
 	if (ret) {
 		printf("The initialization failed with error code %d\n", ret);
 		goto out;
 	}
-	ec = jent_entropy_collector_alloc(0, flags);
+	ec = jent_entropy_collector_alloc(osr, flags);
 	if (!ec) {
 		ret = 1;
 		goto out;
 	}
 
-	ec_min = jent_entropy_collector_alloc(0, flags);
+	ec_min = jent_entropy_collector_alloc(osr, flags);
 	if (!ec_min) {
 		ret = 1;
 		goto out;
@@ -115,6 +145,7 @@ static int jent_one_test(const char *pathname, unsigned long rounds,
 		jent_measure_jitter(ec_min, 1, &duration_min[size]);
 	}
 
+	jent_write_header(out, ec, rounds, flags, rec);
 	for (size = 0; size < rounds; size++)
 		fprintf(out, "%" PRIu64 " %" PRIu64 "\n", duration[size], duration_min[size]);
 
@@ -154,6 +185,70 @@ out:
 	return ret;
 }
 
+static int jent_max_mem(const char *arg, unsigned int *flags)
+{
+	unsigned long val = strtoul(arg, NULL, 10);
+
+	/* A later option replaces the maximum memory size of an earlier one */
+	*flags &= ~JENT_MAX_MEMSIZE_MASK;
+
+	switch (val) {
+	case 0:
+		/* Allow to set no option */
+		break;
+	case 1:
+		*flags |= JENT_MAX_MEMSIZE_32kB;
+		break;
+	case 2:
+		*flags |= JENT_MAX_MEMSIZE_64kB;
+		break;
+	case 3:
+		*flags |= JENT_MAX_MEMSIZE_128kB;
+		break;
+	case 4:
+		*flags |= JENT_MAX_MEMSIZE_256kB;
+		break;
+	case 5:
+		*flags |= JENT_MAX_MEMSIZE_512kB;
+		break;
+	case 6:
+		*flags |= JENT_MAX_MEMSIZE_1MB;
+		break;
+	case 7:
+		*flags |= JENT_MAX_MEMSIZE_2MB;
+		break;
+	case 8:
+		*flags |= JENT_MAX_MEMSIZE_4MB;
+		break;
+	case 9:
+		*flags |= JENT_MAX_MEMSIZE_8MB;
+		break;
+	case 10:
+		*flags |= JENT_MAX_MEMSIZE_16MB;
+		break;
+	case 11:
+		*flags |= JENT_MAX_MEMSIZE_32MB;
+		break;
+	case 12:
+		*flags |= JENT_MAX_MEMSIZE_64MB;
+		break;
+	case 13:
+		*flags |= JENT_MAX_MEMSIZE_128MB;
+		break;
+	case 14:
+		*flags |= JENT_MAX_MEMSIZE_256MB;
+		break;
+	case 15:
+		*flags |= JENT_MAX_MEMSIZE_512MB;
+		break;
+	default:
+		printf("Unknown maximum memory value\n");
+		return 1;
+	}
+
+	return 0;
+}
+
 /*
  * Invoke the application with
  *	argv[1]: number of raw entropy measurements to be obtained for one
@@ -162,16 +257,32 @@ out:
  *		 allocated for each round - this satisfies the restart tests
  *		 defined in SP800-90B section 3.1.4.3 and FIPS IG 7.18.
  *	argv[3]: File name of the output data
+ *	argv[4]: optional maximum memory size, see --max-mem
+ *	argv[5]: optional, any value forces the internal timer
+ *
+ * The following options may be given after the file name:
+ *	--osr <OSR>:		oversampling rate
+ *	--max-mem <NUM>:	maximum memory size (0 = default,
+ *				1 = JENT_MAX_MEMSIZE_32kB ...
+ *				15 = JENT_MAX_MEMSIZE_512MB)
+ *	--flags <FLAGS>:	flags in hexadecimal notation ORed to the flags
+ *	--force-internal-timer:	use the internal timer
+ *	--disable-internal-timer: use the hardware timer only
+ *	--aux <NAME>:		register the auxiliary noise source (repeatable)
+ *	--cpu <CPU>:		pin the recording to the CPU
+ *	--sched-fifo:		use the SCHED_FIFO real-time policy
+ *	--mlockall:		lock all memory of the process
  */
 int main(int argc, char * argv[])
 {
 	unsigned long i, rounds, repeats;
-	unsigned int flags = 0;
-	int ret;
+	struct jent_recording rec = JENT_RECORDING_INIT;
+	unsigned int flags = 0, osr = 0, positional = 0;
+	int ret, arg;
 	char pathname[4096];
 
-	if (argc != 4 && argc != 5 && argc != 6) {
-		printf("%s <rounds per repeat> <number of repeats> <filename> <max mem>\n", argv[0]);
+	if (argc < 4) {
+		printf("%s <rounds per repeat> <number of repeats> <filename> [<max mem> [<force internal timer>]] [--osr <OSR>] [--max-mem <NUM>] [--flags <FLAGS>] [--force-internal-timer|--disable-internal-timer] " JENT_AUXNOISE_USAGE " " JENT_RECORDING_USAGE "\n", argv[0]);
 		return 1;
 	}
 
@@ -183,73 +294,61 @@ int main(int argc, char * argv[])
 	if (repeats >= UINT_MAX)
 		return 1;
 
-	if (argc >= 5) {
-		unsigned long val = strtoul(argv[4], NULL, 10);
-
-		switch (val) {
-		case 0:
-			/* Allow to set no option */
-			break;
-		case 1:
-			flags |= JENT_MAX_MEMSIZE_32kB;
-			break;
-		case 2:
-			flags |= JENT_MAX_MEMSIZE_64kB;
-			break;
-		case 3:
-			flags |= JENT_MAX_MEMSIZE_128kB;
-			break;
-		case 4:
-			flags |= JENT_MAX_MEMSIZE_256kB;
-			break;
-		case 5:
-			flags |= JENT_MAX_MEMSIZE_512kB;
-			break;
-		case 6:
-			flags |= JENT_MAX_MEMSIZE_1MB;
-			break;
-		case 7:
-			flags |= JENT_MAX_MEMSIZE_2MB;
-			break;
-		case 8:
-			flags |= JENT_MAX_MEMSIZE_4MB;
-			break;
-		case 9:
-			flags |= JENT_MAX_MEMSIZE_8MB;
-			break;
-		case 10:
-			flags |= JENT_MAX_MEMSIZE_16MB;
-			break;
-		case 11:
-			flags |= JENT_MAX_MEMSIZE_32MB;
-			break;
-		case 12:
-			flags |= JENT_MAX_MEMSIZE_64MB;
-			break;
-		case 13:
-			flags |= JENT_MAX_MEMSIZE_128MB;
-			break;
-		case 14:
-			flags |= JENT_MAX_MEMSIZE_256MB;
-			break;
-		case 15:
-			flags |= JENT_MAX_MEMSIZE_512MB;
-			break;
-		default:
-			printf("Unknown maximum memory value\n");
+	for (arg = 4; arg < argc; arg++) {
+		ret = jent_recording_option(&rec, argc, argv, &arg);
+		if (ret < 0)
+			return 1;
+		if (ret)
+			continue;
+
+		ret = jent_auxnoise_option(argc, argv, &arg);
+		if (ret < 0)
+			return 1;
+		if (ret)
+			continue;
+
+		if (!strcmp(argv[arg], "--osr") && arg + 1 < argc) {
+			unsigned long val = strtoul(argv[++arg], NULL, 10);
+
+			if (val >= UINT_MAX)
+				return 1;
+			osr = (unsigned int)val;
+		} else if (!strcmp(argv[arg], "--max-mem") && arg + 1 < argc) {
+			if (jent_max_mem(argv[++arg], &flags))
+				return 1;
+		} else if (!strcmp(argv[arg], "--flags") && arg + 1 < argc) {
+			flags |= (unsigned int)strtoul(argv[++arg], NULL, 16);
+		} else if (!strcmp(argv[arg], "--force-internal-timer")) {
+			flags |= JENT_FORCE_INTERNAL_TIMER;
+		} else if (!strcmp(argv[arg], "--disable-internal-timer")) {
+			flags |= JENT_DISABLE_INTERNAL_TIMER;
+		} else if (!strncmp(argv[arg], "--", 2)) {
+			printf("Unknown option %s\n", argv[arg]);
+			return 1;
+		} else if (positional == 0) {
+			/* Maximum memory size given as 4th argument */
+			if (jent_max_mem(argv[arg], &flags))
+				return 1;
+			positional++;
+		} else if (positional == 1) {
+			/* Any 5th argument forces the internal timer */
+			flags |= JENT_FORCE_INTERNAL_TIMER;
+			positional++;
+		} else {
+			printf("Unknown argument %s\n", argv[arg]);
 			return 1;
 		}
 	}
 
-	if (argc == 6)
-		flags |= JENT_FORCE_INTERNAL_TIMER;
+	if (jent_recording_setup(&rec))
+		return 1;
 
 	for (i = 1; i <= repeats; i++) {
 		snprintf(pathname, sizeof(pathname), "%s-%.4lu.data", argv[3],
 			 i);
 
-		ret = jent_one_test(pathname, rounds, flags,
-				    REPORT_COUNTER_TICKS);
+		ret = jent_one_test(pathname, rounds, osr, flags,
+				    REPORT_COUNTER_TICKS, &rec);
 
 		if (ret)
 			return ret;
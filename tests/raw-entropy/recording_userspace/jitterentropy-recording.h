@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2022, Stephan Mueller <smueller@chronox.de>
+ *
+ * License: see LICENSE file in root directory
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Execution environment of the recording tools
+ *
+ * The recording can be pinned to one CPU, operated with the SCHED_FIFO
+ * real-time policy and with all memory locked to obtain the best-case
+ * jitter, or run without these options to obtain the worst case. The
+ * execution environment is written as comment lines starting with '#'.
+ *
+ * The file must be included before any system header as it requires
+ * _GNU_SOURCE.
+ */
+
+#ifndef JITTERENTROPY_RECORDING_H
+#define JITTERENTROPY_RECORDING_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+struct jent_recording {
+	int cpu;		/* CPU to pin to, -1 for no pinning */
+	int sched_fifo;		/* Use the SCHED_FIFO policy */
+	int mlockall;		/* Lock all current and future memory */
+};
+
+#define JENT_RECORDING_INIT { -1, 0, 0 }
+
+#ifdef CPU_SETSIZE
+#define JENT_RECORDING_MAX_CPU CPU_SETSIZE
+#else
+#define JENT_RECORDING_MAX_CPU 1024
+#endif
+
+#define JENT_RECORDING_USAGE "[--cpu <CPU>] [--sched-fifo] [--mlockall]"
+
+/*
+ * Parse the option at argv[*arg] - returns 1 if the option is consumed,
+ * 0 if it is no recording option and -1 on an error.
+ */
+static inline int jent_recording_option(struct jent_recording *rec, int argc,
+					char *argv[], int *arg)
+{
+	if (!strcmp(argv[*arg], "--cpu")) {
+		char *end;
+		long val;
+
+		if (*arg + 1 >= argc) {
+			printf("CPU value missing\n");
+			return -1;
+		}
+		val = strtol(argv[++(*arg)], &end, 10);
+		if (*end || val < 0 || val >= JENT_RECORDING_MAX_CPU) {
+			printf("Invalid CPU %s\n", argv[*arg]);
+			return -1;
+		}
+		rec->cpu = (int)val;
+		return 1;
+	}
+
+	if (!strcmp(argv[*arg], "--sched-fifo")) {
+		rec->sched_fifo = 1;
+		return 1;
+	}
+
+	if (!strcmp(argv[*arg], "--mlockall")) {
+		rec->mlockall = 1;
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Apply the execution environment to the calling process */
+static inline int jent_recording_setup(const struct jent_recording *rec)
+{
+#ifdef __linux__
+	if (rec->cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(rec->cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set)) {
+			printf("Pinning to CPU %d failed: %s\n", rec->cpu,
+			       strerror(errno));
+			return 1;
+		}
+	}
+
+	if (rec->sched_fifo) {
+		struct sched_param param;
+
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+		if (sched_setscheduler(0, SCHED_FIFO, &param)) {
+			printf("Setting SCHED_FIFO failed: %s\n",
+			       strerror(errno));
+			return 1;
+		}
+	}
+
+	if (rec->mlockall && mlockall(MCL_CURRENT | MCL_FUTURE)) {
+		printf("Locking the memory failed: %s\n", strerror(errno));
+		return 1;
+	}
+
+	return 0;
+#else
+	if (rec->cpu >= 0 || rec->sched_fifo || rec->mlockall) {
+		printf("CPU pinning, SCHED_FIFO and memory locking are only supported on Linux\n");
+		return 1;
+	}
+
+	return 0;
+#endif
+}
+
+#ifdef __linux__
+/* Read the first line of a sysfs file, "-" if it is not available */
+static inline void jent_recording_sysfs(const char *pathname, char *buf,
+					size_t len)
+{
+	FILE *f = fopen(pathname, "r");
+
+	if (!f || !fgets(buf, (int)len, f) || buf[0] == '\n')
+		snprintf(buf, len, "-");
+	else
+		buf[strcspn(buf, "\n")] = '\0';
+
+	if (f)
+		fclose(f);
+}
+
+/* Is the CPU contained in a CPU list like "1-3,5"? */
+static inline int jent_recording_cpu_in_list(const char *list, int cpu)
+{
+	while (*list >= '0' && *list <= '9') {
+		char *end;
+		long first = strtol(list, &end, 10), last = first;
+
+		if (*end == '-')
+			last = strtol(end + 1, &end, 10);
+		if (cpu >= first && cpu <= last)
+			return 1;
+		if (*end != ',')
+			break;
+		list = end + 1;
+	}
+
+	return 0;
+}
+#endif
+
+/* Write the execution environment as comment lines */
+static inline void jent_recording_metadata(FILE *out,
+					   const struct jent_recording *rec)
+{
+#ifdef __linux__
+	char pathname[128], governor[64], freq[64], isolated[256], nohz[256];
+	int cpu = sched_getcpu();
+
+	snprintf(pathname, sizeof(pathname),
+		 "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", cpu);
+	jent_recording_sysfs(pathname, governor, sizeof(governor));
+	snprintf(pathname, sizeof(pathname),
+		 "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu);
+	jent_recording_sysfs(pathname, freq, sizeof(freq));
+	jent_recording_sysfs("/sys/devices/system/cpu/isolated", isolated,
+			     sizeof(isolated));
+	jent_recording_sysfs("/sys/devices/system/cpu/nohz_full", nohz,
+			     sizeof(nohz));
+
+	fprintf(out, "# cpu=%d pinned=%s sched=%s mlockall=%s\n", cpu,
+		rec->cpu >= 0 ? "yes" : "no",
+		rec->sched_fifo ? "fifo" : "other",
+		rec->mlockall ? "yes" : "no");
+	fprintf(out, "# governor=%s cur_freq_khz=%s isolated=%s (isolated cpus: %s, nohz_full cpus: %s)\n",
+		governor, freq,
+		jent_recording_cpu_in_list(isolated, cpu) ? "yes" : "no",
+		isolated, nohz);
+#else
+	fprintf(out, "# pinned=no sched=other mlockall=no\n");
+	(void)rec;
+#endif
+}
+
+#endif /* JITTERENTROPY_RECORDING_H */
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2022, Stephan Mueller <smueller@chronox.de>
+ *
+ * License: see LICENSE file in root directory
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Replay a recorded timer trace through the Jitter RNG
+ *
+ * The trace is a file of time deltas in native 64 bit integers which is
+ * mapped into memory and registered with jent_entropy_switch_timer_replay.
+ * Random blocks are generated from it and the health test results, the
+ * duration and a fingerprint of the output are reported. Two runs with the
+ * same trace and options produce the same result. A trace can be converted
+ * from a recording of jitterentropy-hashtime with --convert.
+ *
+ * The Jitter RNG must be compiled with JENT_CONF_TIMER_REPLAY.
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "jitterentropy.h"
+
+#define REPLAY_BLOCKSIZE 32
+
+static void replay_usage(const char *name)
+{
+	printf("%s <trace> <number of blocks> [--osr <OSR>] [--flags <FLAGS>]\n",
+	       name);
+	printf("%s --convert <recording> <trace>\n", name);
+}
+
+/* Convert the var sample of a jitterentropy-hashtime recording */
+static int replay_convert(const char *recording, const char *trace)
+{
+	FILE *in, *out;
+	char buf[64];
+	unsigned long count = 0;
+	int ret = 0;
+
+	in = fopen(recording, "r");
+	if (!in) {
+		printf("Cannot open %s\n", recording);
+		return 1;
+	}
+
+	out = fopen(trace, "wb");
+	if (!out) {
+		printf("Cannot open %s\n", trace);
+		fclose(in);
+		return 1;
+	}
+
+	while (fgets(buf, sizeof(buf), in)) {
+		uint64_t delta;
+		char *end;
+
+		/* Skip the configuration header of the recording */
+		if (buf[0] == '#')
+			continue;
+
+		delta = strtoull(buf, &end, 10);
+		if (end == buf)
+			continue;
+
+		if (fwrite(&delta, sizeof(delta), 1, out) != 1) {
+			printf("Cannot write %s\n", trace);
+			ret = 1;
+			break;
+		}
+		count++;
+	}
+
+	fclose(in);
+	if (fclose(out))
+		ret = 1;
+
+	if (!ret)
+		printf("Converted %lu time deltas\n", count);
+
+	return ret;
+}
+
+static uint64_t replay_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int replay_run(const uint64_t *trace, size_t num, unsigned long blocks,
+		      unsigned int osr, unsigned int flags)
+{
+	struct rand_data *ec;
+	unsigned char buf[REPLAY_BLOCKSIZE], fingerprint[REPLAY_BLOCKSIZE];
+	uint64_t start, duration;
+	unsigned long i;
+	unsigned int j;
+	int ret;
+
+	ret = jent_entropy_switch_timer_replay(trace, num);
+	if (ret) {
+		printf("Registering the trace failed with error code %d%s\n",
+		       ret, ret == -EOPNOTSUPP ?
+		       " - compile the Jitter RNG with JENT_CONF_TIMER_REPLAY" :
+		       "");
+		return 1;
+	}
+
+	/* The trace replaces any time stamp source including the internal timer */
+	flags |= JENT_DISABLE_INTERNAL_TIMER;
+
+	ret = jent_entropy_init_ex(osr, flags);
+	if (ret) {
+		printf("The initialization failed with error code %d\n", ret);
+		return 1;
+	}
+
+	ec = jent_entropy_collector_alloc(osr, flags);
+	if (!ec) {
+		printf("Allocation of the entropy collector failed\n");
+		return 1;
+	}
+
+	memset(fingerprint, 0, sizeof(fingerprint));
+	start = replay_time();
+	for (i = 0; i < blocks; i++) {
+		ssize_t len = jent_read_entropy(ec, (char *)buf, sizeof(buf));
+
+		if (len < 0) {
+			printf("Block %lu: jent_read_entropy failed with error code %zd\n",
+			       i, len);
+			ret = 1;
+			break;
+		}
+
+		for (j = 0; j < sizeof(buf); j++)
+			fingerprint[j] ^= buf[j];
+	}
+	duration = replay_time() - start;
+
+	printf("Generated %lu blocks from %zu time deltas in %" PRIu64 " ns (%" PRIu64 " ns/block)\n",
+	       i, num, duration, i ? duration / i : 0);
+
+	printf("Output fingerprint: ");
+	for (j = 0; j < sizeof(fingerprint); j++)
+		printf("%02x", fingerprint[j]);
+	printf("\n");
+
+	jent_entropy_collector_free(ec);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long blocks, val;
+	unsigned int flags = 0, osr = 0;
+	struct stat sb;
+	void *trace;
+	int fd, ret;
+
+	if (argc == 4 && !strcmp(argv[1], "--convert"))
+		return replay_convert(argv[2], argv[3]);
+
+	if (argc < 3) {
+		replay_usage(argv[0]);
+		return 1;
+	}
+
+	blocks = strtoul(argv[2], NULL, 10);
+
+	for (ret = 3; ret < argc; ret++) {
+		if (!strcmp(argv[ret], "--osr") && ret + 1 < argc) {
+			val = strtoul(argv[++ret], NULL, 10);
+			if (val >= UINT_MAX)
+				return 1;
+			osr = (unsigned int)val;
+		} else if (!strcmp(argv[ret], "--flags") && ret + 1 < argc) {
+			flags = (unsigned int)strtoul(argv[++ret], NULL, 16);
+		} else {
+			replay_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	fd = open(argv[1], O_RDONLY);
+	if (fd < 0) {
+		printf("Cannot open %s\n", argv[1]);
+		return 1;
+	}
+
+	if (fstat(fd, &sb) || sb.st_size < (off_t)sizeof(uint64_t)) {
+		printf("Trace %s is empty\n", argv[1]);
+		close(fd);
+		return 1;
+	}
+
+	trace = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (trace == MAP_FAILED) {
+		printf("Cannot map %s\n", argv[1]);
+		return 1;
+	}
+
+	ret = replay_run(trace, (size_t)sb.st_size / sizeof(uint64_t), blocks,
+			 osr, flags);
+
+	munmap(trace, (size_t)sb.st_size);
+
+	return ret;
+}
@@ -17,6 +17,8 @@
  * DAMAGE.
  */
 
+#include "jitterentropy-recording.h"
+
 #include <stdlib.h>
 #include <limits.h>
 #include <stdio.h>
@@ -30,9 +32,10 @@ int main(int argc, char * argv[])
 	int ret = 0;
 	unsigned int flags = 0, osr = 0;
 	struct rand_data *ec_nostir;
+	struct jent_recording rec = JENT_RECORDING_INIT;
 
 	if (argc < 2) {
-		printf("%s <number of measurements> [--force-fips|--disable-memory-access|--disable-internal-timer|--force-internal-timer|--osr <OSR>|--max-mem <NUM>]\n", argv[0]);
+		printf("%s <number of measurements> [--force-fips|--disable-memory-access|--disable-internal-timer|--force-internal-timer|--osr <OSR>|--max-mem <NUM>] " JENT_RECORDING_USAGE "\n", argv[0]);
 		return 1;
 	}
 
@@ -43,6 +46,17 @@ int main(int argc, char * argv[])
 	argv++;
 
 	while (argc > 1) {
+		int arg = 1;
+
+		ret = jent_recording_option(&rec, argc, argv, &arg);
+		if (ret < 0)
+			return 1;
+		if (ret) {
+			argc -= arg;
+			argv += arg;
+			continue;
+		}
+
 		if (!strncmp(argv[1], "--force-fips", 12))
 			flags |= JENT_FORCE_FIPS;
 		else if (!strncmp(argv[1], "--disable-memory-access", 23))
@@ -138,6 +152,9 @@ int main(int argc, char * argv[])
 		argv++;
 	}
 
+	if (jent_recording_setup(&rec))
+		return 1;
+
 	ret = jent_entropy_init_ex(osr, flags);
 	if (ret) {
 		printf("The initialization failed with error code %d\n", ret);
@@ -150,6 +167,11 @@ int main(int argc, char * argv[])
 		return 1;
 	}
 
+	/* The random data is written to stdout, the metadata to stderr */
+	fprintf(stderr, "# jitterentropy-rng osr=%u flags=0x%x\n",
+		ec_nostir->osr, flags);
+	jent_recording_metadata(stderr, &rec);
+
 	for (size = 0; size < rounds; size++) {
 		char tmp[32];
 
@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2022, Stephan Mueller <smueller@chronox.de>
+ *
+ * License: see LICENSE file in root directory
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Benchmark of time stamp sources
+ *
+ * For every time stamp source, the cost of one read operation is measured
+ * and the raw time deltas of the Jitter RNG noise source are recorded with
+ * that time stamp source registered via jent_entropy_switch_timer_impl.
+ * As the time stamp source can only be switched before jent_entropy_init,
+ * every time stamp source is tested in its own child process.
+ *
+ * The internal timer is measured with one timer thread per entropy collector
+ * and with one timer thread shared by all entropy collectors. To compare
+ * both, several entropy collectors can be operated in parallel, each in its
+ * own thread. The entropy rate is then reported for all collectors combined.
+ *
+ * The wait strategies used while waiting for the internal timer to advance
+ * are compared by the wall time per sample and the CPU time consumed by the
+ * process relative to the wall time.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "jitterentropy-sha3.c"
+#include "jitterentropy-cache.c"
+#include "jitterentropy-gcd.c"
+#include "jitterentropy-estimator.c"
+#include "jitterentropy-health.c"
+#include "jitterentropy-noise.c"
+#include "jitterentropy-timer.c"
+#include "jitterentropy-base.c"
+
+#define TIMER_READS 1000000
+
+static void timer_clock(clockid_t clk, uint64_t *out)
+{
+	struct timespec time;
+
+	if (clock_gettime(clk, &time) == 0) {
+		*out = ((uint64_t)time.tv_sec & 0xFFFFFFFF) * 1000000000UL;
+		*out += (uint64_t)time.tv_nsec;
+	} else {
+		*out = 0;
+	}
+}
+
+static void timer_builtin(uint64_t *out)
+{
+	jent_get_nstime(out);
+}
+
+static void timer_realtime(uint64_t *out)
+{
+	timer_clock(CLOCK_REALTIME, out);
+}
+
+static void timer_monotonic(uint64_t *out)
+{
+	timer_clock(CLOCK_MONOTONIC, out);
+}
+
+#ifdef CLOCK_MONOTONIC_RAW
+static void timer_monotonic_raw(uint64_t *out)
+{
+	timer_clock(CLOCK_MONOTONIC_RAW, out);
+}
+#endif
+
+#if defined(__x86_64__)
+static void timer_rdtscp(uint64_t *out)
+{
+	uint64_t low, high;
+	uint32_t aux;
+
+	__asm__ __volatile__("rdtscp" : "=a" (low), "=d" (high), "=c" (aux));
+	*out = low | (high << 32);
+}
+#endif
+
+/*
+ * read:  time stamp read function whose cost is measured (if any)
+ * ext:   time stamp source registered with the Jitter RNG (if any)
+ * flags: flags for the allocation of the entropy collector
+ */
+static const struct timer_source {
+	const char *name;
+	jent_timer_read_cb read;
+	jent_timer_read_cb ext;
+	unsigned int flags;
+} timer_sources[] = {
+	{ "builtin", timer_builtin, NULL, JENT_DISABLE_INTERNAL_TIMER },
+#if defined(__x86_64__)
+	{ "rdtscp", timer_rdtscp, timer_rdtscp, JENT_DISABLE_INTERNAL_TIMER },
+#endif
+#ifdef CLOCK_MONOTONIC_RAW
+	{ "clock_monotonic_raw", timer_monotonic_raw, timer_monotonic_raw,
+	  JENT_DISABLE_INTERNAL_TIMER },
+#endif
+	{ "clock_monotonic", timer_monotonic, timer_monotonic,
+	  JENT_DISABLE_INTERNAL_TIMER },
+	{ "clock_realtime", timer_realtime, timer_realtime,
+	  JENT_DISABLE_INTERNAL_TIMER },
+#ifdef JENT_CONF_ENABLE_INTERNAL_TIMER
+	{ "notime", NULL, NULL, JENT_FORCE_INTERNAL_TIMER },
+	{ "notime_spin", NULL, NULL,
+	  JENT_FORCE_INTERNAL_TIMER | JENT_NOTIME_WAIT_SPIN },
+	{ "notime_bounded", NULL, NULL,
+	  JENT_FORCE_INTERNAL_TIMER | JENT_NOTIME_WAIT_BOUNDED },
+	{ "notime_shared", NULL, NULL,
+	  JENT_FORCE_INTERNAL_TIMER | JENT_NOTIME_SHARED },
+#endif
+};
+
+struct timer_worker {
+	pthread_t thread;
+	unsigned int flags;
+	unsigned long rounds;
+	uint64_t *delta;
+	int ret;
+};
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Most Common Value estimate following SP800-90B section 6.3.1 - the data
+ * is sorted by this function.
+ */
+static double mcv_min_entropy(uint64_t *data, unsigned long n)
+{
+	unsigned long i, run = 1, max_run = 1;
+	double p, pu;
+
+	if (n < 2)
+		return 0;
+
+	qsort(data, n, sizeof(uint64_t), cmp_u64);
+	for (i = 1; i < n; i++) {
+		if (data[i] == data[i - 1]) {
+			run++;
+			if (run > max_run)
+				max_run = run;
+		} else {
+			run = 1;
+		}
+	}
+
+	p = (double)max_run / (double)n;
+	pu = p + 2.576 * sqrt(p * (1.0 - p) / (double)(n - 1));
+	if (pu > 1.0)
+		pu = 1.0;
+
+	return -log2(pu);
+}
+
+static uint64_t now_ns(void)
+{
+	uint64_t t;
+
+	timer_clock(CLOCK_MONOTONIC, &t);
+	return t;
+}
+
+static uint64_t cpu_ns(void)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage))
+		return 0;
+
+	return ((uint64_t)usage.ru_utime.tv_sec +
+		(uint64_t)usage.ru_stime.tv_sec) * 1000000000UL +
+	       ((uint64_t)usage.ru_utime.tv_usec +
+		(uint64_t)usage.ru_stime.tv_usec) * 1000UL;
+}
+
+/* Record the raw time deltas of the noise source of one entropy collector */
+static void *timer_worker(void *arg)
+{
+	struct timer_worker *worker = (struct timer_worker *)arg;
+	struct rand_data *ec;
+	unsigned long i;
+
+	worker->ret = 1;
+
+	ec = jent_entropy_collector_alloc(0, worker->flags);
+	if (!ec)
+		return NULL;
+
+	if (jent_notime_settick(ec))
+		goto out;
+
+	jent_measure_jitter(ec, 0, NULL);
+	for (i = 0; i < worker->rounds; i++)
+		jent_measure_jitter(ec, 0, &worker->delta[i]);
+
+	jent_notime_unsettick(ec);
+	worker->ret = 0;
+
+out:
+	jent_entropy_collector_free(ec);
+	return NULL;
+}
+
+static int timer_bench(const struct timer_source *src, unsigned long rounds,
+		       unsigned int collectors)
+{
+	struct timer_worker *workers;
+	uint64_t *delta, start, end, cpu_start, cpu_end, t;
+	double read_ns = 0, sample_ns, cpu, mean = 0, var = 0, h;
+	unsigned long i, total = rounds * collectors;
+	unsigned int j;
+	int ret = 1;
+
+	if (src->ext && jent_entropy_switch_timer_impl(src->ext))
+		return 1;
+
+	/* Cost of one time stamp read */
+	if (src->read) {
+		start = now_ns();
+		for (i = 0; i < TIMER_READS; i++)
+			src->read(&t);
+		end = now_ns();
+		read_ns = (double)(end - start) / TIMER_READS;
+	}
+
+	/* Power-on validation of the time stamp source */
+	ret = jent_entropy_init_ex(0, src->flags);
+	if (ret) {
+		printf("%-20s %10.2f  init failed with error %d\n",
+		       src->name, read_ns, ret);
+		return 0;
+	}
+
+	delta = calloc(total, sizeof(uint64_t));
+	workers = calloc(collectors, sizeof(struct timer_worker));
+	if (!delta || !workers) {
+		ret = 1;
+		goto out;
+	}
+
+	/* Raw time deltas of the noise source */
+	cpu_start = cpu_ns();
+	start = now_ns();
+	for (j = 0; j < collectors; j++) {
+		workers[j].flags = src->flags;
+		workers[j].rounds = rounds;
+		workers[j].delta = delta + j * rounds;
+		workers[j].ret = 1;
+		if (pthread_create(&workers[j].thread, NULL, timer_worker,
+				   &workers[j]))
+			break;
+	}
+	collectors = j;
+	for (j = 0; j < collectors; j++)
+		pthread_join(workers[j].thread, NULL);
+	end = now_ns();
+	cpu_end = cpu_ns();
+
+	ret = !collectors;
+	for (j = 0; j < collectors; j++)
+		ret |= workers[j].ret;
+	if (ret)
+		goto out;
+
+	total = rounds * collectors;
+	sample_ns = (double)(end - start) / (double)rounds;
+	cpu = 100.0 * (double)(cpu_end - cpu_start) / (double)(end - start);
+
+	for (i = 0; i < total; i++)
+		mean += (double)delta[i];
+	mean /= (double)total;
+	for (i = 0; i < total; i++)
+		var += ((double)delta[i] - mean) * ((double)delta[i] - mean);
+	var /= (double)total;
+
+	h = mcv_min_entropy(delta, total);
+
+	printf("%-20s %10.2f %10.2f %8.1f %12.2f %12.2f %8.4f %12.6f\n",
+	       src->name, read_ns, sample_ns, cpu, mean, sqrt(var), h,
+	       h * collectors / sample_ns);
+
+out:
+	free(workers);
+	free(delta);
+
+	return ret;
+}
+
+/*
+ * Invoke the application with
+ *	argv[1]: number of raw entropy measurements to be obtained per time
+ *		 stamp source and entropy collector (default 100000)
+ *	argv[2]: number of entropy collectors operated in parallel (default 1)
+ */
+int main(int argc, char *argv[])
+{
+	unsigned long rounds = 100000, collectors = 1;
+	unsigned int i;
+	int ret = 0;
+
+	if (argc > 3) {
+		printf("%s [<number of measurements> [<number of collectors>]]\n",
+		       argv[0]);
+		return 1;
+	}
+
+	if (argc >= 2) {
+		rounds = strtoul(argv[1], NULL, 10);
+		if (!rounds || rounds >= UINT_MAX)
+			return 1;
+	}
+
+	if (argc == 3) {
+		collectors = strtoul(argv[2], NULL, 10);
+		if (!collectors || collectors > 1024 ||
+		    rounds * collectors >= UINT_MAX)
+			return 1;
+	}
+
+	printf("%-20s %10s %10s %8s %12s %12s %8s %12s\n", "source",
+	       "ns/read", "ns/sample", "CPU %", "delta mean", "delta sdev",
+	       "H_min", "H_min/ns");
+
+	for (i = 0; i < ARRAY_SIZE(timer_sources); i++) {
+		pid_t pid;
+		int status;
+
+		fflush(stdout);
+		pid = fork();
+		if (pid < 0)
+			return 1;
+		if (pid == 0)
+			return timer_bench(&timer_sources[i], rounds,
+					   (unsigned int)collectors);
+
+		if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status))
+			ret = 1;
+	}
+
+	return ret;
+}
@@ -0,0 +1,194 @@
+#!/bin/bash
+#
+# Tool to record raw entropy for a matrix of Jitter RNG options in parallel
+#
+# Each cell of the matrix spanned by OSR_LIST, MAXMEM_LIST, FLAGS_LIST and
+# TIMER_LIST is recorded with jitterentropy-hashtime into its own directory
+# $OUTDIR-osr<OSR>-maxmem<NUM>-flags<FLAGS>-<TIMER> which can be processed
+# with the tools in ../validation-runtime. Several cells are recorded at the
+# same time, each pinned to its own CPU.
+#
+
+############################################################
+# Configuration values                                     #
+############################################################
+
+# Directory prefix where to store the measurements
+OUTDIR=${OUTDIR:-"../results-measurements"}
+
+# Number of time deltas recorded per cell
+NUM_EVENTS=${NUM_EVENTS:-1000000}
+
+# Oversampling rates to be tested (0 -> use default)
+OSR_LIST=${OSR_LIST:-"0"}
+
+# Maximum memory sizes to be tested
+# 0 -> use default
+# 1 -> JENT_MAX_MEMSIZE_32kB
+# ...
+# 15 -> JENT_MAX_MEMSIZE_512MB
+MAXMEM_LIST=${MAXMEM_LIST:-"0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15"}
+
+# Additional flags in hexadecimal notation to be tested
+FLAGS_LIST=${FLAGS_LIST:-"0"}
+
+# Timer modes to be tested: "hardware" and / or "internal"
+TIMER_LIST=${TIMER_LIST:-"hardware"}
+
+# CPUs available for the recording. Preferably, these CPUs are isolated
+# from the scheduler with the isolcpus kernel command line option. The
+# default are the isolated CPUs or all CPUs except CPU 0.
+CPUS=${CPUS:-""}
+
+# Use only every CPU_SPACING-th CPU of CPUS for a recording to limit the
+# interference between the parallel recordings, e.g. 2 leaves the SMT
+# sibling of each used CPU idle.
+CPU_SPACING=${CPU_SPACING:-1}
+
+# Maximum number of parallel recordings (0 -> one per used CPU)
+MAX_JOBS=${MAX_JOBS:-0}
+
+# Additional options of jitterentropy-hashtime, e.g. "--sched-fifo --mlockall"
+# to record the best-case jitter
+RECORDING_OPTS=${RECORDING_OPTS:-""}
+
+############################################################
+# Code only after this line -- do not change               #
+############################################################
+
+expand_cpulist()
+{
+	local item
+	local i
+
+	for item in ${1//,/ }
+	do
+		if [ "${item#*-}" != "$item" ]
+		then
+			for i in $(seq ${item%-*} ${item#*-})
+			do
+				echo -n "$i "
+			done
+		else
+			echo -n "$item "
+		fi
+	done
+}
+
+select_cpus()
+{
+	local cpus="$CPUS"
+	local used=""
+	local cpu
+	local i=0
+
+	if [ -z "$cpus" ] && [ -f /sys/devices/system/cpu/isolated ]
+	then
+		cpus=$(expand_cpulist $(cat /sys/devices/system/cpu/isolated))
+	fi
+
+	if [ -z "$cpus" ]
+	then
+		cpus=$(expand_cpulist $(cat /sys/devices/system/cpu/online))
+		# Keep CPU 0 for the system unless it is the only one
+		if [ "$cpus" != "0 " ]
+		then
+			cpus=${cpus#0 }
+		fi
+	fi
+
+	for cpu in $(expand_cpulist "$cpus")
+	do
+		if [ $(($i % $CPU_SPACING)) -eq 0 ]
+		then
+			used="$used $cpu"
+		fi
+		i=$(($i+1))
+	done
+
+	echo $used
+}
+
+record_cell()
+{
+	local cpu=$1
+	local osr=$2
+	local maxmem=$3
+	local flags=$4
+	local timer=$5
+	local target="$OUTDIR-osr${osr}-maxmem${maxmem}-flags${flags}-${timer}"
+	local cmdopts="--osr $osr --max-mem $maxmem --flags $flags"
+
+	if [ "$timer" = "internal" ]
+	then
+		cmdopts="$cmdopts --force-internal-timer"
+	else
+		cmdopts="$cmdopts --disable-internal-timer"
+	fi
+
+	mkdir -p $target
+	if [ $? -ne 0 ]
+	then
+		echo "Creation of $target failed"
+		return 1
+	fi
+
+	echo "CPU $cpu: recording $target"
+	./jitterentropy-hashtime $NUM_EVENTS 1 $target/jent-raw-noise $cmdopts --cpu $cpu $RECORDING_OPTS > $target/recording.log 2>&1
+	if [ $? -ne 0 ]
+	then
+		echo "Recording $target failed, see $target/recording.log"
+		return 1
+	fi
+}
+
+# Each job records the cells assigned to it one after the other on its CPU
+run_job()
+{
+	local job=$1
+	local cpu=$2
+	local cell=0
+	local osr maxmem flags timer
+
+	for osr in $OSR_LIST
+	do
+		for maxmem in $MAXMEM_LIST
+		do
+			for flags in $FLAGS_LIST
+			do
+				for timer in $TIMER_LIST
+				do
+					if [ $(($cell % $NUM_JOBS)) -eq $job ]
+					then
+						record_cell $cpu $osr $maxmem $flags $timer
+					fi
+					cell=$(($cell+1))
+				done
+			done
+		done
+	done
+}
+
+USED_CPUS=($(select_cpus))
+NUM_JOBS=${#USED_CPUS[@]}
+if [ $MAX_JOBS -gt 0 ] && [ $MAX_JOBS -lt $NUM_JOBS ]
+then
+	NUM_JOBS=$MAX_JOBS
+fi
+
+if [ $NUM_JOBS -eq 0 ]
+then
+	echo "No CPU available for the recording"
+	exit 1
+fi
+
+trap "make -s -f Makefile.hashtime clean" 0 1 2 3 15
+make -s -f Makefile.hashtime || exit 1
+
+echo "Recording with $NUM_JOBS parallel jobs on CPUs ${USED_CPUS[@]:0:$NUM_JOBS}"
+
+for job in $(seq 0 $(($NUM_JOBS-1)))
+do
+	run_job $job ${USED_CPUS[$job]} &
+done
+wait
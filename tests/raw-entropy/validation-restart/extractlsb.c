@@ -194,6 +194,10 @@ int main(int argc, char *argv[])
 		char *saveptr = NULL;
 	 	char *res = NULL;
 
+		/* Skip the configuration header of the recording */
+		if (buf[0] == '#')
+			continue;
+
 		i++;
 
 		res = strtok_r(buf, " ", &saveptr);
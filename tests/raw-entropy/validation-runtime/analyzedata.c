@@ -0,0 +1,692 @@
+/*
+ * Copyright (C) 2019 - 2022, Stephan Mueller <smueller@chronox.de>
+ *
+ * License: see LICENSE file in root directory
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * The tool analyzes the recorded time deltas of many measurements in
+ * parallel. For each input file and each mask, the significant bits of the
+ * var sample are extracted the same way as done by extractlsb and the
+ * following SP800-90B estimators are applied:
+ *
+ *	* Most Common Value estimate on the extracted symbols (6.3.1)
+ *
+ *	* Collision estimate on the bit string of the symbols (6.3.2)
+ *
+ *	* Markov estimate on the bit string of the symbols (6.3.3)
+ *
+ * The min entropy is the minimum of the symbol estimate and the bit string
+ * estimates scaled by the symbol size which is what ea_non_iid reports for
+ * these estimators. The min entropy divided by the mean time delta gives the
+ * entropy per timer tick which allows comparing configurations that differ
+ * in speed. The results are written as CSV and JSON summary together with one
+ * histogram of the extracted symbols per input file and mask.
+ *
+ * The result is meant to quickly compare many configurations. It is no
+ * replacement for a full assessment with the SP800-90B tool.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <libgen.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define BITS_PER_SAMPLE 64
+#define MAX_MASKS 16
+#define MARKOV_BITS 128
+#define Z_ALPHA 2.576
+
+/* Name of the raw noise file looked up in a measurement directory */
+#define NONIID_DATA "jent-raw-noise-0001.data"
+
+struct mask_result {
+	uint64_t mask;
+	int bits;
+	uint64_t unchanged0s;		/* Bits always 0 in the var sample */
+	uint64_t unchanged1s;		/* Bits always 1 in the var sample */
+	double mcv;
+	double collision;
+	double markov;
+	double min_entropy;
+};
+
+struct input {
+	char *path;			/* Recording read by the tool */
+	char *name;			/* Name used for the output files */
+	uint32_t samples;
+	double mean_delta;		/* Mean time delta in timer ticks */
+	int error;
+	struct mask_result res[MAX_MASKS];
+};
+
+struct analysis {
+	struct input *inputs;
+	unsigned int ninputs;
+	unsigned int next;		/* Next input to be processed */
+	pthread_mutex_t lock;		/* Protects next */
+
+	uint64_t masks[MAX_MASKS];
+	unsigned int nmasks;
+	uint32_t maxevents;
+	const char *outdir;
+};
+
+/*
+	Extract bits from sample based on significant bit mask
+*/
+
+static unsigned char extract(uint64_t sample, uint64_t mask)
+{
+	unsigned char byte = 0;
+	int i, j = 0;
+
+	for (i = 0; i < BITS_PER_SAMPLE && mask; i++) {
+		if (mask & 1) {
+			byte |= (unsigned char)((sample & 1) << j);
+			j++;
+		}
+		mask >>= 1;
+		sample >>= 1;
+	}
+	return (byte);
+}
+
+/*
+	Convert mask in hexadecimal format to binary
+*/
+
+static int hextolong(const char *p_strmask, uint64_t *p_mask)
+{
+	uint64_t mask = 0;
+	int count = 0;
+
+	while (*p_strmask) {
+		count++;
+		mask <<= 4;
+
+		if ((*p_strmask >= '0') && (*p_strmask <= '9'))
+			mask |= (uint64_t)(*p_strmask - '0');
+		else if ((*p_strmask >= 'A') && (*p_strmask <= 'F'))
+			mask |= (uint64_t)(*p_strmask - 'A' + 10);
+		else if ((*p_strmask >= 'a') && (*p_strmask <= 'f'))
+			mask |= (uint64_t)(*p_strmask - 'a' + 10);
+		else
+			return -1;
+
+		p_strmask++;
+	}
+
+	if (!count || count > 16)
+		return(-1);
+
+	*p_mask = mask;
+	return(0);
+}
+
+/*
+	Count the number of bits on
+*/
+
+static int bitcount(uint64_t mask)
+{
+	int j = 0;
+
+	while (mask) {
+		j += (int)(mask & 1);
+		mask >>= 1;
+	}
+	return (j);
+}
+
+/*
+	SP800-90B section 6.3.1: Most Common Value estimate
+*/
+
+static double mcv_estimate(const uint32_t *hist, uint32_t len)
+{
+	uint32_t max = 0;
+	double p, pu;
+	unsigned int i;
+
+	for (i = 0; i < 256; i++) {
+		if (hist[i] > max)
+			max = hist[i];
+	}
+
+	p = (double)max / len;
+	pu = p + Z_ALPHA * sqrt(p * (1.0 - p) / (len - 1));
+	if (pu >= 1.0)
+		return 0.0;
+
+	return -log2(pu);
+}
+
+static inline int getbit(const unsigned char *sym, int bits, uint64_t i)
+{
+	return (sym[i / (unsigned int)bits] >> (bits - 1 - (int)(i % (unsigned int)bits))) & 1;
+}
+
+/*
+	SP800-90B section 6.3.2: Collision estimate of a bit string
+*/
+
+static double collision_estimate(const unsigned char *sym, int bits,
+				 uint32_t len)
+{
+	uint64_t nbits = (uint64_t)len * (unsigned int)bits, i = 0;
+	uint64_t v = 0, sum = 0, sum2 = 0;
+	double mean, sigma, x, p;
+
+	while (i + 1 < nbits) {
+		unsigned int t;
+
+		if (getbit(sym, bits, i) == getbit(sym, bits, i + 1))
+			t = 2;
+		else if (i + 2 < nbits)
+			t = 3;
+		else
+			break;
+
+		v++;
+		sum += t;
+		sum2 += t * t;
+		i += t;
+	}
+
+	if (v < 2)
+		return 0.0;
+
+	mean = (double)sum / v;
+	sigma = sqrt(((double)sum2 - (double)v * mean * mean) / (v - 1));
+	x = mean - Z_ALPHA * sigma / sqrt((double)v);
+
+	/*
+	 * The expected distance between collisions of a bit string with the
+	 * probability p for the more likely value is 2 + 2p(1 - p).
+	 */
+	if (x <= 2.0)
+		return 0.0;
+	else if (x >= 2.5)
+		p = 0.5;
+	else
+		p = (1.0 + sqrt(5.0 - 2.0 * x)) / 2.0;
+
+	return -log2(p);
+}
+
+/*
+	SP800-90B section 6.3.3: Markov estimate of a bit string
+*/
+
+static double markov_estimate(const unsigned char *sym, int bits,
+			      uint32_t len)
+{
+	uint64_t nbits = (uint64_t)len * (unsigned int)bits, i;
+	uint64_t c[2] = { 0 }, t[2][2] = { { 0 } };
+	double p0, p1, p00, p01, p10, p11, lp[6], max;
+	int prev, cur;
+	unsigned int k;
+
+	prev = getbit(sym, bits, 0);
+	c[prev]++;
+	for (i = 1; i < nbits; i++) {
+		cur = getbit(sym, bits, i);
+		c[cur]++;
+		t[prev][cur]++;
+		prev = cur;
+	}
+
+	p0 = (double)c[0] / nbits;
+	p1 = (double)c[1] / nbits;
+	p00 = (t[0][0] + t[0][1]) ? (double)t[0][0] / (t[0][0] + t[0][1]) : 0;
+	p01 = (t[0][0] + t[0][1]) ? (double)t[0][1] / (t[0][0] + t[0][1]) : 0;
+	p10 = (t[1][0] + t[1][1]) ? (double)t[1][0] / (t[1][0] + t[1][1]) : 0;
+	p11 = (t[1][0] + t[1][1]) ? (double)t[1][1] / (t[1][0] + t[1][1]) : 0;
+
+	/* log2 probabilities of the most likely 128 bit sequences */
+	lp[0] = log2(p0) + (MARKOV_BITS - 1) * log2(p00);
+	lp[1] = log2(p0) + (MARKOV_BITS / 2) * log2(p01) +
+		(MARKOV_BITS / 2 - 1) * log2(p10);
+	lp[2] = log2(p0) + log2(p01) + (MARKOV_BITS - 2) * log2(p11);
+	lp[3] = log2(p1) + log2(p10) + (MARKOV_BITS - 2) * log2(p00);
+	lp[4] = log2(p1) + (MARKOV_BITS / 2) * log2(p10) +
+		(MARKOV_BITS / 2 - 1) * log2(p01);
+	lp[5] = log2(p1) + (MARKOV_BITS - 1) * log2(p11);
+
+	max = lp[0];
+	for (k = 1; k < 6; k++) {
+		if (lp[k] > max)
+			max = lp[k];
+	}
+
+	if (max >= 0.0)
+		return 0.0;
+
+	max = -max / MARKOV_BITS;
+	return (max > 1.0) ? 1.0 : max;
+}
+
+static int write_histogram(struct analysis *a, struct input *in,
+			   struct mask_result *res, const uint32_t *hist)
+{
+	char pathname[4096];
+	unsigned int i;
+	FILE *out;
+
+	snprintf(pathname, sizeof(pathname), "%s/%s.hist_%" PRIX64 ".csv",
+		 a->outdir, in->name, res->mask);
+	out = fopen(pathname, "w");
+	if (!out) {
+		printf("File %s cannot be opened for write\n", pathname);
+		return -errno;
+	}
+
+	fprintf(out, "symbol,count\n");
+	for (i = 0; i < (1U << res->bits); i++)
+		fprintf(out, "%u,%u\n", i, hist[i]);
+
+	fclose(out);
+	return 0;
+}
+
+/* Discard the remainder of a line that did not fit into the buffer */
+static void skip_line(FILE *f, const char *buf)
+{
+	size_t len = strlen(buf);
+	int c;
+
+	if (len && buf[len - 1] == '\n')
+		return;
+
+	do {
+		c = fgetc(f);
+	} while (c != EOF && c != '\n');
+}
+
+static int analyze_input(struct analysis *a, struct input *in)
+{
+	uint64_t *samples = NULL;
+	unsigned char *sym = NULL;
+	uint32_t hist[256];
+	uint32_t i = 0;
+	unsigned int m;
+	char buf[64];
+	FILE *f;
+	int ret = 0;
+
+	f = fopen(in->path, "r");
+	if (!f) {
+		printf("File %s cannot be opened for read\n", in->path);
+		return -errno;
+	}
+
+	samples = malloc(a->maxevents * sizeof(*samples));
+	sym = malloc(a->maxevents);
+	if (!samples || !sym) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* Only the var sample in the first column is analyzed */
+	while (i < a->maxevents && fgets(buf, sizeof(buf), f)) {
+		char *end;
+
+		skip_line(f, buf);
+
+		/* Skip the configuration header of the recording */
+		if (buf[0] == '#')
+			continue;
+
+		samples[i] = strtoull(buf, &end, 10);
+		if (end == buf)
+			continue;
+		i++;
+	}
+	in->samples = i;
+
+	if (i < 2) {
+		printf("File %s contains insufficient samples\n", in->path);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	in->mean_delta = 0;
+	for (i = 0; i < in->samples; i++)
+		in->mean_delta += (double)samples[i];
+	in->mean_delta /= in->samples;
+
+	for (m = 0; m < a->nmasks; m++) {
+		struct mask_result *res = &in->res[m];
+		double h_bits;
+
+		res->mask = a->masks[m];
+		res->bits = bitcount(res->mask);
+		res->unchanged0s = 0;
+		res->unchanged1s = ~(uint64_t)0;
+		memset(hist, 0, sizeof(hist));
+
+		for (i = 0; i < in->samples; i++) {
+			res->unchanged0s |= samples[i];
+			res->unchanged1s &= samples[i];
+			sym[i] = extract(samples[i], res->mask);
+			hist[sym[i]]++;
+		}
+
+		res->mcv = mcv_estimate(hist, in->samples);
+		res->collision = collision_estimate(sym, res->bits,
+						    in->samples);
+		res->markov = markov_estimate(sym, res->bits, in->samples);
+
+		h_bits = (res->collision < res->markov) ?
+			 res->collision : res->markov;
+		h_bits *= res->bits;
+		res->min_entropy = (res->mcv < h_bits) ? res->mcv : h_bits;
+
+		ret = write_histogram(a, in, res, hist);
+		if (ret)
+			goto out;
+	}
+
+out:
+	free(samples);
+	free(sym);
+	fclose(f);
+	return ret;
+}
+
+static void *analyze_thread(void *arg)
+{
+	struct analysis *a = (struct analysis *)arg;
+
+	for (;;) {
+		struct input *in;
+
+		pthread_mutex_lock(&a->lock);
+		if (a->next >= a->ninputs) {
+			pthread_mutex_unlock(&a->lock);
+			break;
+		}
+		in = &a->inputs[a->next++];
+		pthread_mutex_unlock(&a->lock);
+
+		in->error = analyze_input(a, in);
+	}
+
+	return NULL;
+}
+
+/*
+	A measurement directory is analyzed by its raw noise file, a
+	recording file is analyzed directly.
+*/
+
+static int setup_input(struct input *in, const char *arg)
+{
+	struct stat sb;
+	char *tmp, *name;
+	size_t len;
+
+	if (stat(arg, &sb)) {
+		printf("File %s cannot be accessed\n", arg);
+		return -errno;
+	}
+
+	tmp = strdup(arg);
+	if (!tmp)
+		return -ENOMEM;
+	name = basename(tmp);
+
+	if (S_ISDIR(sb.st_mode)) {
+		len = strlen(arg) + sizeof(NONIID_DATA) + 1;
+		in->path = malloc(len);
+		if (in->path)
+			snprintf(in->path, len, "%s/%s", arg, NONIID_DATA);
+	} else {
+		char *ext = strrchr(name, '.');
+
+		if (ext && ext != name)
+			*ext = '\0';
+		in->path = strdup(arg);
+	}
+
+	in->name = strdup(name);
+	free(tmp);
+
+	if (!in->path || !in->name)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static int write_summary(struct analysis *a)
+{
+	char pathname[4096];
+	unsigned int i, m;
+	FILE *csv, *json;
+	int first = 1;
+
+	snprintf(pathname, sizeof(pathname), "%s/summary.csv", a->outdir);
+	csv = fopen(pathname, "w");
+	if (!csv) {
+		printf("File %s cannot be opened for write\n", pathname);
+		return -errno;
+	}
+
+	snprintf(pathname, sizeof(pathname), "%s/summary.json", a->outdir);
+	json = fopen(pathname, "w");
+	if (!json) {
+		printf("File %s cannot be opened for write\n", pathname);
+		fclose(csv);
+		return -errno;
+	}
+
+	fprintf(csv, "input,mask,bits,samples,mcv,collision,markov,min_entropy,mean_delta,entropy_per_tick,constant0s,constant1s\n");
+	fprintf(json, "[\n");
+
+	for (i = 0; i < a->ninputs; i++) {
+		struct input *in = &a->inputs[i];
+
+		if (in->error)
+			continue;
+
+		for (m = 0; m < a->nmasks; m++) {
+			struct mask_result *res = &in->res[m];
+			double per_tick = in->mean_delta > 0 ?
+					  res->min_entropy / in->mean_delta : 0;
+
+			fprintf(csv, "%s,%" PRIX64 ",%d,%u,%f,%f,%f,%f,%f,%g,%016" PRIx64 ",%016" PRIx64 "\n",
+				in->name, res->mask, res->bits, in->samples,
+				res->mcv, res->collision, res->markov,
+				res->min_entropy, in->mean_delta, per_tick,
+				~res->unchanged0s, res->unchanged1s);
+
+			fprintf(json, "%s  {\"input\": \"%s\", \"mask\": \"%" PRIX64 "\", \"bits\": %d, \"samples\": %u, \"mcv\": %f, \"collision\": %f, \"markov\": %f, \"min_entropy\": %f, \"mean_delta\": %f, \"entropy_per_tick\": %g, \"constant0s\": \"%016" PRIx64 "\", \"constant1s\": \"%016" PRIx64 "\"}",
+				first ? "" : ",\n", in->name, res->mask,
+				res->bits, in->samples, res->mcv,
+				res->collision, res->markov, res->min_entropy,
+				in->mean_delta, per_tick,
+				~res->unchanged0s, res->unchanged1s);
+			first = 0;
+		}
+	}
+
+	fprintf(json, "\n]\n");
+	fclose(csv);
+	fclose(json);
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [options] <measurement directory or file>...\n", name);
+	printf("\t-j --jobs <NUM>\t\tNumber of parallel jobs (default: number of CPUs)\n");
+	printf("\t-m --mask <HEX>\t\tMask of significant bits, may be given up to %d times (default: 0F and FF)\n", MAX_MASKS);
+	printf("\t-n --maxevents <NUM>\tMaximum number of samples per file (default: 1000000)\n");
+	printf("\t-o --output <DIR>\tDirectory for the summary and histograms (default: .)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct analysis a;
+	pthread_t *threads = NULL;
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned long jobs = (ncpu > 0) ? (unsigned long)ncpu : 1;
+	unsigned long started = 0, i;
+	int c, ret = 1;
+
+	memset(&a, 0, sizeof(a));
+	a.maxevents = 1000000;
+	a.outdir = ".";
+
+	for (;;) {
+		int opt_index = 0;
+		static struct option options[] = {
+			{"jobs", required_argument, 0, 'j'},
+			{"mask", required_argument, 0, 'm'},
+			{"maxevents", required_argument, 0, 'n'},
+			{"output", required_argument, 0, 'o'},
+			{"help", no_argument, 0, 'h'},
+			{0, 0, 0, 0}
+		};
+
+		c = getopt_long(argc, argv, "j:m:n:o:h", options, &opt_index);
+		if (-1 == c)
+			break;
+		switch (c) {
+		case 'j':
+			jobs = strtoul(optarg, NULL, 10);
+			if (!jobs) {
+				printf("Number of jobs must be positive\n");
+				return 1;
+			}
+			break;
+		case 'm':
+			if (a.nmasks >= MAX_MASKS) {
+				printf("At most %d masks are supported\n",
+				       MAX_MASKS);
+				return 1;
+			}
+			if (hextolong(optarg, &a.masks[a.nmasks])) {
+				printf("Mask value is incorrect [%s], use up to 16 hexadecimal characters\n", optarg);
+				return 1;
+			}
+			if (!a.masks[a.nmasks] ||
+			    bitcount(a.masks[a.nmasks]) > 8) {
+				printf("Mask [%s] must select 1 to 8 bits\n",
+				       optarg);
+				return 1;
+			}
+			a.nmasks++;
+			break;
+		case 'n':
+			a.maxevents = (uint32_t)strtoul(optarg, NULL, 10);
+			if (a.maxevents < 2) {
+				printf("At least 2 samples are required\n");
+				return 1;
+			}
+			break;
+		case 'o':
+			a.outdir = optarg;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!a.nmasks) {
+		a.masks[a.nmasks++] = 0x0F;
+		a.masks[a.nmasks++] = 0xFF;
+	}
+
+	if (mkdir(a.outdir, 0777) && errno != EEXIST) {
+		printf("Directory %s cannot be created\n", a.outdir);
+		return 1;
+	}
+
+	a.ninputs = (unsigned int)(argc - optind);
+	a.inputs = calloc(a.ninputs, sizeof(*a.inputs));
+	if (!a.inputs)
+		return 1;
+
+	for (i = 0; i < a.ninputs; i++) {
+		if (setup_input(&a.inputs[i], argv[optind + (int)i]))
+			goto out;
+	}
+
+	if (pthread_mutex_init(&a.lock, NULL))
+		goto out;
+
+	if (jobs > a.ninputs)
+		jobs = a.ninputs;
+	threads = calloc(jobs, sizeof(*threads));
+	if (!threads)
+		goto out_lock;
+
+	for (started = 0; started < jobs; started++) {
+		if (pthread_create(&threads[started], NULL, analyze_thread,
+				   &a))
+			break;
+	}
+
+	/* Analyze in the main thread if no worker could be started */
+	if (!started)
+		analyze_thread(&a);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	ret = 0;
+	for (i = 0; i < a.ninputs; i++) {
+		if (a.inputs[i].error)
+			ret = 1;
+	}
+
+	if (write_summary(&a))
+		ret = 1;
+
+	printf("Analyzed %u inputs with %lu jobs, results in %s\n",
+	       a.ninputs, started ? started : 1, a.outdir);
+
+	free(threads);
+out_lock:
+	pthread_mutex_destroy(&a.lock);
+out:
+	for (i = 0; i < a.ninputs; i++) {
+		free(a.inputs[i].path);
+		free(a.inputs[i].name);
+	}
+	free(a.inputs);
+	return ret;
+}
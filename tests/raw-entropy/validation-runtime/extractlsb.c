@@ -129,6 +129,19 @@ static char *printbits(uint64_t sample, int value)
 	return buf;
 }
 
+/* Discard the remainder of a line that did not fit into the buffer */
+static void skip_line(FILE *f, const char *buf)
+{
+	size_t len = strlen(buf);
+	int c;
+
+	if (len && buf[len - 1] == '\n')
+		return;
+
+	do {
+		c = fgetc(f);
+	} while (c != EOF && c != '\n');
+}
 
 int main(int argc, char *argv[])
 {
@@ -194,6 +207,12 @@ int main(int argc, char *argv[])
 		char *saveptr = NULL;
 	 	char *res = NULL;
 
+		skip_line(f, buf);
+
+		/* Skip the configuration header of the recording */
+		if (buf[0] == '#')
+			continue;
+
 		i++;
 
 		res = strtok_r(buf, " ", &saveptr);